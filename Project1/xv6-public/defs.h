@@ -11,10 +11,18 @@ struct stat;
 struct superblock;
 
 struct _QList;
+struct _RunQueue;
 struct _MLFQ;
+struct _MLFQStat;
+struct _SchedEvent;
+struct _MLFQParams;
 
 typedef struct _QList QList;
+typedef struct _RunQueue RunQueue;
 typedef struct _MLFQ MLFQ;
+typedef struct _MLFQStat MLFQStat;
+typedef struct _SchedEvent SchedEvent;
+typedef struct _MLFQParams MLFQParams;
 
 // bio.c
 void            binit(void);
@@ -131,29 +139,62 @@ int             getLevel(void);
 void            setPriority(int, int);
 void            schedulerLock(int);
 void            schedulerUnlock(int);
+void            check_boost(void);
+void            mlfqstat(MLFQStat*, int*);
+void            schedlog(SchedEvent*, int*);
+void            getmlfqparams(MLFQParams*);
+int             setmlfqparams(MLFQParams*);
+
+// timerwheel.c
+void            add_timer(struct proc*, uint);
+int             timer_pending(struct proc*);
+void            del_timer(struct proc*);
+void            expire_timers(void);
+uint            timer_now(void);
 
 // proc_mlfq.c
 void            print_mlfq_err(MLFQ*, struct proc*);
 void            print_p_info(struct proc*);
+void            log_sched_event(int, struct proc*);
+void            copy_sched_log(SchedEvent*, int*);
 void            init_mlfq(MLFQ*, struct proc*);
 int             compare_pvalue(int, int);
 int             compare_priority(struct proc*, struct proc*);
+RunQueue*       get_run_queue(MLFQ*, struct proc*);
+QList*          get_queue(RunQueue*, int, int);
+void            update_queue_mask(RunQueue*, int, int);
+void            sync_boost(MLFQ*, struct proc*);
 void            push_first_elem(QList*, struct proc*);
 void            push_head(QList*, struct proc*);
-void            push_by_priority(QList*, struct proc*);
+void            unlink_elem(QList*, struct proc*);
+void            push_rr_queue(RunQueue*, struct proc*, int);
+void            push_by_priority(RunQueue*, struct proc*);
 struct proc*    pop_tail(QList*);
+void            splice_head(QList*, QList*);
+struct proc*    pop_run_queue(RunQueue*, int, int);
 void            insert_queue(MLFQ*, struct proc*, int, int, int);
 void            delete_from_queue(MLFQ*, struct proc*, int);
-int             get_able_queue(MLFQ*);
-struct proc*    mlfq_select_target(MLFQ*);
+int             get_able_queue(RunQueue*);
+int             select_cpu(MLFQ*);
+struct proc*    steal_target(MLFQ*, int);
+int             in_gang(struct proc*, struct proc*);
+struct proc*    gang_target(MLFQ*, int);
+void            account_run(struct proc*);
+struct proc*    mlfq_select_target(MLFQ*, int);
 void            back_to_mlfq(MLFQ*, struct proc*);
 void            relocate_by_priority(MLFQ*, int, int);
 void            prirority_boost(MLFQ*);
 void            boost_check(MLFQ*);
+int             mlfq_is_idle(MLFQ*);
 int             scheduler_lock(MLFQ*, struct proc*);
 int             scheduler_unlock(MLFQ*);
 void            check_lock_state_when_sched(MLFQ*, struct proc*);
+QList*          get_sleep_queue(MLFQ*, void*);
+void            insert_sleep_queue(MLFQ*, struct proc*);
+void            wakeup_sleep_queue(MLFQ*, void*);
 void            check_wakeup(MLFQ*, struct proc*);
+void            get_mlfq_params(MLFQ*, MLFQParams*);
+int             set_mlfq_params(MLFQ*, MLFQParams*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
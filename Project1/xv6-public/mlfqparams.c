@@ -0,0 +1,48 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "mlfqparams.h"
+
+// usage: mlfqparams                                print current mlfq parameters
+//        mlfqparams l0q l1q l2q boost maxpriority   change mlfq parameters
+
+void
+print_params(MLFQParams* params) {
+  printf(1, "time quantum: L0 %d, L1 %d, L2 %d\n",
+    params->time_quantum[L0], params->time_quantum[L1], params->time_quantum[L2]);
+  printf(1, "boost period: %d\n", params->boost_period);
+  printf(1, "max priority: %d\n", params->max_priority);
+}
+
+int
+main(int argc, char *argv[])
+{
+  MLFQParams params;
+
+  if (argc != 1 && argc != 6) {
+    printf(2, "usage: mlfqparams [l0q l1q l2q boost maxpriority]\n");
+    exit();
+  }
+
+  if (argc == 6) {
+    params.time_quantum[L0] = atoi(argv[1]);
+    params.time_quantum[L1] = atoi(argv[2]);
+    params.time_quantum[L2] = atoi(argv[3]);
+    params.boost_period = atoi(argv[4]);
+    params.max_priority = atoi(argv[5]);
+
+    if (setmlfqparams(&params) < 0) {
+      printf(2, "mlfqparams: invalid parameters\n");
+      exit();
+    }
+  }
+
+  if (getmlfqparams(&params) < 0) {
+    printf(2, "mlfqparams: getmlfqparams failed\n");
+    exit();
+  }
+  print_params(&params);
+
+  exit();
+}
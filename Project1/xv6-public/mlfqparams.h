@@ -0,0 +1,6 @@
+// MLFQ parameters which can be changed at runtime (see setmlfqparams system call)
+typedef struct _MLFQParams {
+  int time_quantum[NMLFQLEVEL];    // time quantum of L0, L1, L2 (1 ~ MLFQMAXTIMEQ)
+  int boost_period;                // ticks between priority boosts (1 ~ MLFQMAXBOOSTTIME)
+  int max_priority;                // L2 priority range is 0 ~ max_priority (0 ~ MLFQMAXPRIORIY)
+} MLFQParams;
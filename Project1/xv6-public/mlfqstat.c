@@ -0,0 +1,103 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "mlfqstat.h"
+
+// usage: mlfqstat       print scheduling statistics of every process
+//        mlfqstat -e    dump scheduling event ring buffer
+
+MLFQStat stat_list[NPROC];
+SchedEvent event_list[NSCHEDEVENT];
+
+char* state_names[] = { "unused", "embryo", "sleep", "runble", "run", "zombie" };
+char* event_names[] = { "run", "demote", "boost", "lock", "unlock", "wakeup", "steal" };
+
+// print integer with right padding so that it takes width characters
+void
+print_int(int n, int width) {
+  int len = 1, i;
+
+  for (i = n; i >= 10 || i <= -10; i /= 10) {
+    len++;
+  }
+  if (n < 0) {
+    len++;
+  }
+
+  printf(1, "%d", n);
+  for (i = len; i < width; i++) {
+    printf(1, " ");
+  }
+}
+
+// print string with right padding so that it takes width characters
+void
+print_str(char* s, int width) {
+  int i;
+
+  printf(1, "%s", s);
+  for (i = strlen(s); i < width; i++) {
+    printf(1, " ");
+  }
+}
+
+void
+print_stat_table() {
+  int num, i;
+
+  if (getmlfqstat(stat_list, &num) < 0) {
+    printf(2, "mlfqstat: getmlfqstat failed\n");
+    return;
+  }
+
+  printf(1, "pid  name            state  lv pr L0    L1    L2    wait  demote boost lock  sched\n");
+  for (i = 0; i < num; i++) {
+    print_int(stat_list[i].pid, 5);
+    print_str(stat_list[i].name, 16);
+    print_str(state_names[stat_list[i].state], 7);
+    print_int(stat_list[i].level, 3);
+    print_int(stat_list[i].priority, 3);
+    print_int(stat_list[i].ticks[L0], 6);
+    print_int(stat_list[i].ticks[L1], 6);
+    print_int(stat_list[i].ticks[L2], 6);
+    print_int(stat_list[i].wait_ticks, 6);
+    print_int(stat_list[i].ndemote, 7);
+    print_int(stat_list[i].nboost, 6);
+    print_int(stat_list[i].lock_ticks, 6);
+    print_int(stat_list[i].nsched, 6);
+    printf(1, "\n");
+  }
+}
+
+void
+print_event_log() {
+  int num, i;
+
+  if (getschedlog(event_list, &num) < 0) {
+    printf(2, "mlfqstat: getschedlog failed\n");
+    return;
+  }
+
+  printf(1, "tick    cpu event   pid  level\n");
+  for (i = 0; i < num; i++) {
+    print_int(event_list[i].tick, 8);
+    print_int(event_list[i].cpu, 4);
+    print_str(event_names[event_list[i].type], 8);
+    print_int(event_list[i].pid, 5);
+    print_int(event_list[i].level, 5);
+    printf(1, "\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "-e") == 0) {
+    print_event_log();
+  } else {
+    print_stat_table();
+  }
+
+  exit();
+}
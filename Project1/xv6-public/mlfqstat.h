@@ -0,0 +1,34 @@
+#define NSCHEDEVENT   256  // size of scheduling event ring buffer
+
+// scheduling event types
+#define SCHEDEV_RUN     0  // process is selected to run
+#define SCHEDEV_DEMOTE  1  // process used all time quantum and moved to lower level
+#define SCHEDEV_BOOST   2  // priority boost (pid is 0)
+#define SCHEDEV_LOCK    3  // process called schedulerLock
+#define SCHEDEV_UNLOCK  4  // scheduler unlocked (by schedulerUnlock, sleep, exit or boost)
+#define SCHEDEV_WAKEUP  5  // sleeping process went back to run queue
+#define SCHEDEV_STEAL   6  // process taken from run queue of other cpu
+
+// Scheduling statistics of a process (see getmlfqstat system call)
+typedef struct _MLFQStat {
+  int pid;
+  char name[16];
+  int state;
+  int level;
+  int priority;
+  uint ticks[NMLFQLEVEL];          // ticks run in each level
+  uint wait_ticks;                 // ticks waited in run queue while RUNNABLE
+  uint ndemote;                    // times moved to lower level
+  uint nboost;                     // priority boosts applied
+  uint lock_ticks;                 // ticks run while holding schedulerLock
+  uint nsched;                     // times selected by scheduler
+} MLFQStat;
+
+// An entry of scheduling event ring buffer (see getschedlog system call)
+typedef struct _SchedEvent {
+  uint tick;
+  int cpu;
+  int type;                        // SCHEDEV_*
+  int pid;
+  int level;                       // level of the process after the event
+} SchedEvent;
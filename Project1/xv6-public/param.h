@@ -20,8 +20,12 @@
 #define L1            1  // RR Scheduling
 #define L2            2  // Priority Scheduling
 
-#define MLFQMAXPRIORIY 3 // mlfq max priority
-#define MLFQBOOSTTIME 100 // mlfq boost time
+#define MLFQMAXPRIORIY 3 // mlfq max priority (default, and the upper bound of setmlfqparams)
+#define MLFQBOOSTTIME 100 // mlfq boost time (default)
+#define MLFQMAXTIMEQ  1000 // upper bound of time quantum for setmlfqparams
+#define MLFQMAXBOOSTTIME 100000 // upper bound of boost time for setmlfqparams
+#define NSLEEPHASH    64  // number of wait lists of sleeping processes (hashed by chan)
+#define NTIMERSLOT    64  // slots per level of sleep timer wheel
 
 #define MLFQLOCKPASSWORD 2019039843 // password for mlfq lock
 
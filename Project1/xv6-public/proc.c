@@ -6,6 +6,8 @@
 #include "x86.h"
 #include "proc.h"
 #include "proc_mlfq.h"
+#include "mlfqstat.h"
+#include "mlfqparams.h"
 #include "spinlock.h"
 
 struct {
@@ -21,8 +23,12 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
-// mlfq
-MLFQ _mlfq = {.MAX_TIME_QUANTUM = {MLFQL0TIMEQ, MLFQL1TIMEQ, MLFQL2TIMEQ}};
+// mlfq, each cpu has its own run queue in it
+MLFQ _mlfq = {
+  .MAX_TIME_QUANTUM = {MLFQL0TIMEQ, MLFQL1TIMEQ, MLFQL2TIMEQ},
+  .boost_period = MLFQBOOSTTIME,
+  .max_priority = MLFQMAXPRIORIY
+};
 
 void
 pinit(void)
@@ -80,6 +86,7 @@ getLevel() {
   struct proc* p = myproc();
 
   acquire(&ptable.lock);
+  sync_boost(&_mlfq, p);
   level = p->mlfq_info.level;
   release(&ptable.lock);
 
@@ -90,14 +97,16 @@ void
 setPriority(int pid, int priority) {
   struct proc* p = myproc();
 
-  if (priority < 0 || priority > 3) {
+  acquire(&ptable.lock);
+
+  if (priority < 0 || priority > _mlfq.max_priority) {
+    release(&ptable.lock);
     cprintf("invalid priority: %d\n", priority);
     return;
   }
 
-  acquire(&ptable.lock);
-
   if (pid == p->pid) { // if the process is running, just set priority value
+    sync_boost(&_mlfq, p);
     p->mlfq_info.priority.pvalue = priority;
   } else {
     // 실행중인 프로세스가 아니라면 큐 내 위치 재조정 필요 (locked process인 경우도 생각)
@@ -149,6 +158,89 @@ schedulerUnlock(int password) {
   release(&ptable.lock);
 }
 
+// Called by the timer interrupt for every tick.
+// Boost only takes ptable.lock when the deadline has passed.
+void
+check_boost(void) {
+  if (ticks < _mlfq.boost_deadline) {
+    return;
+  }
+
+  acquire(&ptable.lock);
+  boost_check(&_mlfq);
+  release(&ptable.lock);
+}
+
+// Store scheduling statistics of all processes (RUNNABLE, RUNNING, SLEEPING, ZOMBIE)
+// stat_list: the statistics will be stored in this array (NPROC entries)
+// num: the number of stored entries will be stored here
+void
+mlfqstat(MLFQStat* stat_list, int* num) {
+  struct proc* p;
+  int i = 0, level;
+
+  acquire(&ptable.lock);
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if (p->state == UNUSED || p->state == EMBRYO) {
+      continue;
+    }
+
+    if (p->state != ZOMBIE) {
+      sync_boost(&_mlfq, p);
+    }
+
+    stat_list[i].pid = p->pid;
+    safestrcpy(stat_list[i].name, p->name, sizeof(p->name));
+    stat_list[i].state = p->state;
+    stat_list[i].level = p->mlfq_info.level;
+    stat_list[i].priority = p->mlfq_info.priority.pvalue;
+    for (level = 0; level < NMLFQLEVEL; level++) {
+      stat_list[i].ticks[level] = p->mlfq_stat.ticks[level];
+    }
+    stat_list[i].wait_ticks = p->mlfq_stat.wait_ticks;
+    stat_list[i].ndemote = p->mlfq_stat.ndemote;
+    stat_list[i].nboost = p->mlfq_stat.nboost;
+    stat_list[i].lock_ticks = p->mlfq_stat.lock_ticks;
+    stat_list[i].nsched = p->mlfq_stat.nsched;
+    i++;
+  }
+
+  *num = i;
+
+  release(&ptable.lock);
+}
+
+// Store the scheduling events in the ring buffer from the oldest one
+// events: the events will be stored in this array (NSCHEDEVENT entries)
+// num: the number of stored events will be stored here
+void
+schedlog(SchedEvent* events, int* num) {
+  acquire(&ptable.lock);
+  copy_sched_log(events, num);
+  release(&ptable.lock);
+}
+
+// Copy current mlfq parameters
+void
+getmlfqparams(MLFQParams* params) {
+  acquire(&ptable.lock);
+  get_mlfq_params(&_mlfq, params);
+  release(&ptable.lock);
+}
+
+// Change mlfq parameters, return -1 when fail
+int
+setmlfqparams(MLFQParams* params) {
+  int flag;
+
+  acquire(&ptable.lock);
+  flag = set_mlfq_params(&_mlfq, params);
+  release(&ptable.lock);
+
+  return flag;
+}
+
 //------------------implemented by me(Yu, Taehwan) for assignment -------------------
 
 
@@ -175,6 +267,7 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  memset(&p->mlfq_stat, 0, sizeof(p->mlfq_stat));
 
   release(&ptable.lock);
 
@@ -236,6 +329,7 @@ userinit(void)
   acquire(&ptable.lock);
 
   p->state = RUNNABLE;
+  p->mlfq_info.cpu = 0;
   insert_queue(&_mlfq, p, L0, TRUE, TRUE); // insert process in to L0 queue after process created
   //cprintf("userinit %d\n", (&_mlfq));
 
@@ -304,6 +398,7 @@ fork(void)
   acquire(&ptable.lock);
 
   np->state = RUNNABLE;
+  np->mlfq_info.cpu = select_cpu(&_mlfq); // put on the least loaded cpu
   insert_queue(&_mlfq, np, L0, TRUE, TRUE); // insert process in to L0 queue after process created
 
   release(&ptable.lock);
@@ -423,13 +518,23 @@ scheduler(void)
   c->proc = 0;
   
   for(;;){
+    // Nothing to run, so halt until the next interrupt
+    // instead of spinning on ptable.lock.
+    // Interrupts are off while checking so the interrupt that makes
+    // a process runnable can't come before the hlt.
+    cli();
+    if (mlfq_is_idle(&_mlfq)) {
+      stihlt();
+      continue;
+    }
+
     // Enable interrupts on this processor.
     sti();
 
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
 
-    p = mlfq_select_target(&_mlfq); // select next process from mlfq
+    p = mlfq_select_target(&_mlfq, cpuid()); // select next process from this cpu's run queue
 
     if (p != NULL_) { // p might be null, so check if p is null or not
       // cprintf("pid: %d, priority: %d, level: %d , tick: %d\n", p->pid, p->mlfq_info.priority.pvalue, p->mlfq_info.level, p->mlfq_info.tick_left);
@@ -454,9 +559,6 @@ scheduler(void)
     //   }
     // }
     
-    // sched will be called for every tick by trap so this will be called by every tick as well
-    boost_check(&_mlfq); 
-
     release(&ptable.lock);
 
   }
@@ -502,7 +604,9 @@ yield(int fromuser)
   acquire(&ptable.lock);  //DOC: yieldlock
   myproc()->state = RUNNABLE;
   if (fromuser) {
-    if (_mlfq.state == LOCKED) { // unlock scheduler if the process called yield by system call
+    // unlock scheduler if the locked process called yield by system call,
+    // not when a process of its gang did
+    if (_mlfq.state == LOCKED && myproc() == _mlfq.locked_proc) {
       scheduler_unlock(&_mlfq);
     }
   }
@@ -557,6 +661,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  insert_sleep_queue(&_mlfq, p);
 
   sched();
 
@@ -576,13 +681,7 @@ sleep(void *chan, struct spinlock *lk)
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan) {
-      p->state = RUNNABLE;
-      check_wakeup(&_mlfq, p); // put the process back to mlfq
-    }
+  wakeup_sleep_queue(&_mlfq, chan); // also puts the processes back to mlfq
 }
 
 // Wake up all processes sleeping on chan.
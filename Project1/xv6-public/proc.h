@@ -54,6 +54,8 @@ struct proc {
   struct {
     int level;                   // current mlfq level
     int tick_left;               // left time quantum
+    int cpu;                     // cpu whose run queue the process belongs to
+    uint boost_epoch;            // boost_epoch of mlfq when the values above were last synced
 
     struct proc* next;
     struct proc* prev;
@@ -63,6 +65,25 @@ struct proc {
       int enter_id;
     } priority;
   } mlfq_info;
+
+  // mlfq statistics (see getmlfqstat)
+  struct {
+    uint ticks[NMLFQLEVEL];      // ticks run in each level
+    uint wait_ticks;             // ticks waited in run queue while RUNNABLE
+    uint runnable_since;         // ticks when the process was put into run queue
+    uint ndemote;                // times moved to lower level
+    uint nboost;                 // priority boosts applied
+    uint lock_ticks;             // ticks run while holding schedulerLock
+    uint nsched;                 // times selected by scheduler
+  } mlfq_stat;
+
+  // timer of sleep system call (see timerwheel.c)
+  struct {
+    uint expires;                // ticks when the timer expires
+    struct proc** slot;          // slot of timer wheel, NULL_ when the timer is not set
+    struct proc* next;
+    struct proc* prev;
+  } sleep_timer;
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -7,9 +7,15 @@
 #include "x86.h"
 #include "traps.h"
 #include "proc_mlfq.h"
+#include "mlfqstat.h"
+#include "mlfqparams.h"
 #include "spinlock.h"
 
-extern int boost_flag;
+// Ring buffer of scheduling events, protected by ptable.lock
+struct {
+  SchedEvent event[NSCHEDEVENT];
+  uint nevent;                     // number of events logged so far, next index is nevent % NSCHEDEVENT
+} sched_log;
 
 // print information of process
 // pid, used time quantum and level
@@ -38,27 +44,82 @@ print_p_info(struct proc* p) {
   );
 }
 
+// Record a scheduling event in the ring buffer.
+// p can be NULL_ for the event not related to a process.
+// Must be called with ptable.lock held.
+void
+log_sched_event(int type, struct proc* p) {
+  SchedEvent* ev = &(sched_log.event[sched_log.nevent % NSCHEDEVENT]);
+
+  ev->tick = ticks;
+  ev->cpu = cpuid();
+  ev->type = type;
+  ev->pid = (p == NULL_) ? 0 : p->pid;
+  ev->level = (p == NULL_) ? -1 : p->mlfq_info.level;
+
+  (sched_log.nevent)++;
+}
+
+// Copy the logged events from the oldest one.
+// At most NSCHEDEVENT events are kept.
+// Must be called with ptable.lock held.
+void
+copy_sched_log(SchedEvent* events, int* num) {
+  uint i, start;
+
+  start = (sched_log.nevent > NSCHEDEVENT) ? sched_log.nevent - NSCHEDEVENT : 0;
+
+  for (i = start; i < sched_log.nevent; i++) {
+    events[i - start] = sched_log.event[i % NSCHEDEVENT];
+  }
+
+  *num = sched_log.nevent - start;
+}
+
 // initialize mlfq
 // must be called right after the ptable initialized
 void
 init_mlfq(MLFQ* mlfq, struct proc* ptable_procs) {
-  int i;
+  int i, c;
   struct proc* iter_ptr;
+  RunQueue* rq;
   
   mlfq->state = IDLE;
   mlfq->ptable_ptr = ptable_procs;
   mlfq->l2q_enter_id = 0;
+  mlfq->boost_deadline = mlfq->boost_period;
+  mlfq->boost_epoch = 0;
   mlfq->locked_proc = NULL_;
 
-  for (i = 0; i < NMLFQLEVEL; ++i) {
-    mlfq->sched_queue[i].head = NULL_;    // NULL_ when empty
-    mlfq->sched_queue[i].tail = NULL_;    // NULL_ when empty
+  for (c = 0; c < NCPU; ++c) {
+    rq = &(mlfq->run_queue[c]);
+
+    for (i = 0; i < L2; ++i) {
+      rq->sched_queue[i].head = NULL_;    // NULL_ when empty
+      rq->sched_queue[i].tail = NULL_;    // NULL_ when empty
+    }
+
+    for (i = 0; i <= MLFQMAXPRIORIY; ++i) {
+      rq->l2_bucket[i].head = NULL_;      // NULL_ when empty
+      rq->l2_bucket[i].tail = NULL_;      // NULL_ when empty
+    }
+
+    rq->level_mask = 0;
+    rq->l2_bucket_mask = 0;
+    rq->nqueued = 0;
+  }
+
+  for (i = 0; i < NSLEEPHASH; ++i) {
+    mlfq->sleep_hash[i].head = NULL_;     // NULL_ when empty
+    mlfq->sleep_hash[i].tail = NULL_;     // NULL_ when empty
   }
 
   for (iter_ptr = mlfq->ptable_ptr; iter_ptr < &((mlfq->ptable_ptr)[NPROC]); iter_ptr++) {
     iter_ptr->mlfq_info.prev = NULL_;  // NULL_ when no prev (I'm the head element)
     iter_ptr->mlfq_info.next = NULL_;  // NULL_ when no next (I'm the tail element)
     iter_ptr->mlfq_info.level = -1;   // -1 when has no head
+    iter_ptr->mlfq_info.cpu = 0;
+    iter_ptr->mlfq_info.boost_epoch = 0;
   }
 }
 
@@ -113,6 +174,59 @@ compare_priority(struct proc* lhs, struct proc* rhs) {
   }
 }
 
+// Return the run queue which the process belongs to.
+RunQueue*
+get_run_queue(MLFQ* mlfq, struct proc* p) {
+  return &(mlfq->run_queue[p->mlfq_info.cpu]);
+}
+
+// Return the queue of given level.
+// L0 and L1 have a single queue, L2 has a queue for each priority value.
+QList*
+get_queue(RunQueue* rq, int level, int pvalue) {
+  if (level == L2) {
+    return &(rq->l2_bucket[pvalue]);
+  }
+  return &(rq->sched_queue[level]);
+}
+
+// Set or clear the bits of the queue in level_mask and l2_bucket_mask.
+// Must be called after a process is pushed to or popped from the queue,
+// so get_able_queue doesn't need to look at every queue.
+void
+update_queue_mask(RunQueue* rq, int level, int pvalue) {
+  if (level == L2) {
+    if (rq->l2_bucket[pvalue].head != NULL_) {
+      rq->l2_bucket_mask |= (1 << pvalue);
+    } else {
+      rq->l2_bucket_mask &= ~(1 << pvalue);
+    }
+  }
+
+  if (get_queue(rq, level, pvalue)->head != NULL_ || (level == L2 && rq->l2_bucket_mask != 0)) {
+    rq->level_mask |= (1 << level);
+  } else {
+    rq->level_mask &= ~(1 << level);
+  }
+}
+
+// Priority boost doesn't touch each process (see prirority_boost).
+// If boost has happened since the process was last synced,
+// reset the level, priority and time quantum of it as boost would have done.
+// Must be called before reading mlfq_info of the process.
+void
+sync_boost(MLFQ* mlfq, struct proc* p) {
+  if (p->mlfq_info.boost_epoch == mlfq->boost_epoch) {
+    return;
+  }
+
+  p->mlfq_stat.nboost += mlfq->boost_epoch - p->mlfq_info.boost_epoch;
+  p->mlfq_info.boost_epoch = mlfq->boost_epoch;
+  p->mlfq_info.level = L0;
+  p->mlfq_info.priority.pvalue = mlfq->max_priority;
+  p->mlfq_info.tick_left = mlfq->MAX_TIME_QUANTUM[L0];
+}
+
 // Put the process into the linked list.
 // Use this function when the linked list is empty.
 void
@@ -167,46 +281,78 @@ void push_tail(QList* queue, struct proc* p) {
   p->mlfq_info.next = NULL_;
 }
 
-// Put the process into the linked list.
-// The process will be located by priority.
-// The head of linked list should has the highest priority (the smallest value).
+// Take out the process from the linked list.
+// The process can be at any position of the list.
 void
-push_by_priority(QList* queue, struct proc* p) {
-  int found = FALSE;
-
-  struct proc* iter_ptr;
-  struct proc* temp;
+unlink_elem(QList* queue, struct proc* p) {
+  if (p->mlfq_info.next == NULL_) { // if p is tail
+    queue->tail = p->mlfq_info.prev;
+  } else {
+    p->mlfq_info.next->mlfq_info.prev = p->mlfq_info.prev;
+  }
 
-  if (queue->head == NULL_) {
-    push_first_elem(queue, p);
-    
-    return;
+  if (p->mlfq_info.prev == NULL_) { // if p is head
+    queue->head = p->mlfq_info.next;
+  } else {
+    p->mlfq_info.prev->mlfq_info.next = p->mlfq_info.next;
   }
 
-  // iterate from head
-  for (iter_ptr = queue->head; iter_ptr != NULL_ && !found; iter_ptr = iter_ptr->mlfq_info.next) {
-    if (compare_priority(p, iter_ptr) <= 0) {
-      // insert before target
-      temp = iter_ptr->mlfq_info.prev;
-      iter_ptr->mlfq_info.prev = p;
-      p->mlfq_info.next = iter_ptr;
-      p->mlfq_info.prev = temp;
+  p->mlfq_info.prev = NULL_;
+  p->mlfq_info.next = NULL_;
+}
 
-      if (temp == NULL_) {
-        // target is head
-        queue->head = p;
-      } else {
-        temp->mlfq_info.next = p;
-      }
+// Put the process into L0 or L1 queue of the run queue.
+// The process will be the head (scheduled last) of the queue,
+// or the tail (scheduled right next) if to_tail is true.
+void
+push_rr_queue(RunQueue* rq, struct proc* p, int to_tail) {
+  int level = p->mlfq_info.level;
 
-      found = TRUE;
-    }
+  if (to_tail) {
+    push_tail(&(rq->sched_queue[level]), p);
+  } else {
+    push_head(&(rq->sched_queue[level]), p);
   }
-  
-  if (!found) {
-    // insert to tail
+
+  (rq->nqueued)++;
+  update_queue_mask(rq, level, 0);
+}
+
+// Put the process into the L2 queue.
+// The process goes to the bucket of its priority value, and inside the bucket
+// it will be located by enter_id.
+// The tail of the bucket should has the highest priority (the smallest enter_id).
+//
+// New processes always have the biggest enter_id and the process which comes back
+// from running had the smallest one, so both are just pushed to the end of bucket.
+// Only a process moved by setPriority might need to iterate the bucket.
+void
+push_by_priority(RunQueue* rq, struct proc* p) {
+  int pvalue = p->mlfq_info.priority.pvalue;
+  QList* queue = &(rq->l2_bucket[pvalue]);
+
+  struct proc* iter_ptr;
+  struct proc* temp;
+
+  if (queue->head == NULL_ || compare_priority(p, queue->head) < 0) {
+    push_head(queue, p);
+  } else if (compare_priority(p, queue->tail) > 0) {
     push_tail(queue, p);
+  } else {
+    // iterate from head, head has lower priority than p and tail has higher priority than p
+    for (iter_ptr = queue->head; compare_priority(p, iter_ptr) > 0; iter_ptr = iter_ptr->mlfq_info.next)
+      ;
+
+    // insert before target
+    temp = iter_ptr->mlfq_info.prev;
+    iter_ptr->mlfq_info.prev = p;
+    p->mlfq_info.next = iter_ptr;
+    p->mlfq_info.prev = temp;
+    temp->mlfq_info.next = p;
   }
+
+  (rq->nqueued)++;
+  update_queue_mask(rq, L2, pvalue);
 }
 
 // take the process out from the tail of the linked list
@@ -228,6 +374,37 @@ pop_tail(QList* queue) {
   return tail_proc;
 }
 
+// Move every process of src to the head side of dst. src becomes empty.
+// Processes of src will be scheduled after the processes of dst.
+void
+splice_head(QList* dst, QList* src) {
+  if (src->head == NULL_) {
+    return;
+  }
+
+  if (dst->head == NULL_) {
+    dst->tail = src->tail;
+  } else {
+    src->tail->mlfq_info.next = dst->head;
+    dst->head->mlfq_info.prev = src->tail;
+  }
+  dst->head = src->head;
+
+  src->head = NULL_;
+  src->tail = NULL_;
+}
+
+// Take the process out from the tail of the queue of given level in the run queue.
+// The queue must not be empty.
+struct proc*
+pop_run_queue(RunQueue* rq, int level, int pvalue) {
+  struct proc* p = pop_tail(get_queue(rq, level, pvalue));
+
+  (rq->nqueued)--;
+  update_queue_mask(rq, level, pvalue);
+  return p;
+}
+
 // Insert process in queue.
 // Initialize mlfq values if needed.
 // This fucntion can be used when the state of process has changed
@@ -236,20 +413,21 @@ void
 insert_queue(MLFQ* mlfq, struct proc* p, int level, int set_priority, int set_timequantum) {
   // common setting for all queues
   if (set_priority) {
-    p->mlfq_info.priority.pvalue = MLFQMAXPRIORIY;
+    p->mlfq_info.priority.pvalue = mlfq->max_priority;
   }
   if (set_timequantum) {
     p->mlfq_info.tick_left = mlfq->MAX_TIME_QUANTUM[level];
   }
   p->mlfq_info.level = level;
+  p->mlfq_info.boost_epoch = mlfq->boost_epoch;
+  p->mlfq_stat.runnable_since = ticks;
 
   if (level == L0 || level == L1) {
     // just put the process at head
-    push_head(&(mlfq->sched_queue[level]), p);
+    push_rr_queue(get_run_queue(mlfq, p), p, FALSE);
   } else {
-    // iterate from head
     p->mlfq_info.priority.enter_id = (mlfq->l2q_enter_id)++;
-    push_by_priority(&(mlfq->sched_queue[level]), p);
+    push_by_priority(get_run_queue(mlfq, p), p);
   }
 }
 
@@ -261,76 +439,199 @@ insert_queue(MLFQ* mlfq, struct proc* p, int level, int set_priority, int set_ti
 // keep_level: true(!= 0) or false(0). keep level value when true. if not, set it -1
 void
 delete_from_queue(MLFQ* mlfq, struct proc* p, int keep_level) {
-  int level = p->mlfq_info.level;
+  int level, pvalue;
+  RunQueue* rq = get_run_queue(mlfq, p);
 
-  struct proc** head_ptr = &(mlfq->sched_queue[level].head);
-  struct proc** tail_ptr = &(mlfq->sched_queue[level].tail);
+  sync_boost(mlfq, p); // the process is in L0 queue if boost has happened
+  level = p->mlfq_info.level;
+  pvalue = p->mlfq_info.priority.pvalue;
 
   if (!keep_level) {
     p->mlfq_info.level = -1;
     p->mlfq_info.tick_left = 0;
   }
 
-  if (p->mlfq_info.next == NULL_) { // if p is tail
-    *(tail_ptr) = p->mlfq_info.prev;
-  } else {
-    p->mlfq_info.next->mlfq_info.prev = p->mlfq_info.prev;
-  }
+  unlink_elem(get_queue(rq, level, pvalue), p);
 
-  if (p->mlfq_info.prev == NULL_) { // if p is head
-    *(head_ptr) = p->mlfq_info.next;
-  } else {
-    p->mlfq_info.prev->mlfq_info.next = p->mlfq_info.next;
+  (rq->nqueued)--;
+  update_queue_mask(rq, level, pvalue);
+}
+
+// Return the level of queue which can be scheduled next.
+// L0 has the highest priority, so the lowest set bit of level_mask is the answer.
+int
+get_able_queue(RunQueue* rq) {
+  if (rq->level_mask == 0) {
+    //panic("No queue can be scheduled");
+    return -1;
   }
 
-  p->mlfq_info.prev = NULL_;
-  p->mlfq_info.next = NULL_;
+  return bsf(rq->level_mask);
 }
 
-// Return the level of queue which can be scheduled next.
-// Check from L0 first, and L1, L2 sequentially.
+// Return the cpu which has the fewest processes in its run queue.
+// New processes are put on that cpu to spread the load.
 int
-get_able_queue(MLFQ* mlfq) {
+select_cpu(MLFQ* mlfq) {
   int i;
-  
-  for (i = 0; i < NMLFQLEVEL; i++) {
-    if (mlfq->sched_queue[i].head != NULL_) {
-      return i;
+  int target_cpu = 0;
+
+  for (i = 1; i < ncpu; i++) {
+    if (mlfq->run_queue[i].nqueued < mlfq->run_queue[target_cpu].nqueued) {
+      target_cpu = i;
     }
   }
 
-  //panic("No queue can be scheduled");
-  return -1;
+  return target_cpu;
 }
 
-// Selct the process that can be scheduled for next tick from the mlfq.
-// Get the process from the tail of the able queue.
-// If SchedulerLock has called, then just return the process that called SchedulerLock
+// Called when the run queue of the cpu is empty.
+// Find the cpu which has the most processes in its run queue,
+// and take the process from the tail of its lowest level queue.
+// (the lowest level has the least chance to run on that cpu soon)
+// The stolen process belongs to the cpu from now on.
+//
+// return NULL_ when every run queue is empty
 struct proc*
-mlfq_select_target(MLFQ* mlfq) {
+steal_target(MLFQ* mlfq, int cpu) {
+  int i;
   int target_level;
+  int target_pvalue = 0;
+  RunQueue* victim = NULL_;
   struct proc* target_proc;
 
+  for (i = 0; i < ncpu; i++) {
+    if (i == cpu || mlfq->run_queue[i].nqueued == 0) {
+      continue;
+    }
+    if (victim == NULL_ || mlfq->run_queue[i].nqueued > victim->nqueued) {
+      victim = &(mlfq->run_queue[i]);
+    }
+  }
+
+  if (victim == NULL_) {
+    return NULL_;
+  }
+
+  target_level = bsr(victim->level_mask);
+  if (target_level == L2) {
+    target_pvalue = bsr(victim->l2_bucket_mask); // the biggest priority value
+  }
+
+  target_proc = pop_run_queue(victim, target_level, target_pvalue);
+  target_proc->mlfq_info.cpu = cpu;
+  log_sched_event(SCHEDEV_STEAL, target_proc);
+
+  return target_proc;
+}
+
+// Return TRUE if the process belongs to the gang of the locked process.
+// The gang is the locked process, its children and its siblings,
+// and only the gang is scheduled on every cpu while mlfq is LOCKED.
+int
+in_gang(struct proc* locked, struct proc* p) {
+  if (p == locked || p->parent == locked) {
+    return TRUE;
+  }
+  return locked->parent != NULL_ && p->parent == locked->parent;
+}
+
+// Called while mlfq is LOCKED and the locked process is running on other cpu.
+// Find a RUNNABLE process of the gang, preferring the one in this cpu's run queue
+// and then the lower level, and take it out of its run queue.
+// The process belongs to the cpu from now on.
+//
+// return NULL_ when no process of the gang can run (the cpu idles)
+struct proc*
+gang_target(MLFQ* mlfq, int cpu) {
+  struct proc* iter_ptr;
+  struct proc* target_proc = NULL_;
+
+  for (iter_ptr = mlfq->ptable_ptr; iter_ptr < &((mlfq->ptable_ptr)[NPROC]); iter_ptr++) {
+    if (iter_ptr->state != RUNNABLE || iter_ptr == mlfq->locked_proc || !in_gang(mlfq->locked_proc, iter_ptr)) {
+      continue;
+    }
+    sync_boost(mlfq, iter_ptr);
+
+    if (target_proc == NULL_
+      || (iter_ptr->mlfq_info.cpu == cpu && target_proc->mlfq_info.cpu != cpu)
+      || ((iter_ptr->mlfq_info.cpu == cpu) == (target_proc->mlfq_info.cpu == cpu)
+        && iter_ptr->mlfq_info.level < target_proc->mlfq_info.level)) {
+      target_proc = iter_ptr;
+    }
+  }
+
+  if (target_proc == NULL_) {
+    return NULL_;
+  }
+
+  delete_from_queue(mlfq, target_proc, TRUE);
+  if (target_proc->mlfq_info.cpu != cpu) {
+    target_proc->mlfq_info.cpu = cpu;
+    log_sched_event(SCHEDEV_STEAL, target_proc);
+  }
+
+  return target_proc;
+}
+
+// Update statistics of the process selected to run.
+void
+account_run(struct proc* p) {
+  if (ticks >= p->mlfq_stat.runnable_since) { // ticks is reset by schedulerLock
+    p->mlfq_stat.wait_ticks += ticks - p->mlfq_stat.runnable_since;
+  }
+  (p->mlfq_stat.nsched)++;
+
+  log_sched_event(SCHEDEV_RUN, p);
+}
+
+// Selct the process that can be scheduled for next tick on the cpu.
+// Get the process from the tail of the able queue of the cpu's run queue,
+// or steal one from other cpu if the run queue is empty.
+// If SchedulerLock has called, then return the process that called SchedulerLock,
+// or a process of its gang if the locked process is running on other cpu
+struct proc*
+mlfq_select_target(MLFQ* mlfq, int cpu) {
+  int target_level;
+  int target_pvalue = 0;
+  struct proc* target_proc;
+  RunQueue* rq = &(mlfq->run_queue[cpu]);
+
   if (mlfq->state == UNLOCK_REQUIRE) {
     panic("mlfq state is UNLOCK_REQUIRE");
   }
 
   if (mlfq->state == LOCKED) {
-    return mlfq->locked_proc;
-  }
+    if (mlfq->locked_proc->state == RUNNABLE) {
+      account_run(mlfq->locked_proc);
+      return mlfq->locked_proc;
+    }
 
-  target_level = get_able_queue(mlfq);
-  if (target_level == -1) {
-    return NULL_;
+    target_proc = gang_target(mlfq, cpu);
+    if (target_proc == NULL_) {
+      return NULL_;
+    }
+  } else if ((target_level = get_able_queue(rq)) == -1) {
+    target_proc = steal_target(mlfq, cpu);
+    if (target_proc == NULL_) {
+      return NULL_;
+    }
+  } else {
+    if (target_level == L2) {
+      target_pvalue = bsf(rq->l2_bucket_mask); // the smallest priority value
+    }
+
+    target_proc = pop_run_queue(rq, target_level, target_pvalue);
   }
-  
-  target_proc = pop_tail(&(mlfq->sched_queue[target_level]));
 
   if (target_proc->state != RUNNABLE) {
     print_mlfq_err(mlfq, target_proc);
     cprintf("Schedule target proc state was: %d\n", (int)target_proc->state);
     panic("Schedule target process was not runnable");
   }
+
+  sync_boost(mlfq, target_proc);
+  account_run(target_proc);
   
   return target_proc;
 }
@@ -342,16 +643,22 @@ mlfq_select_target(MLFQ* mlfq) {
 // 
 // Check the state of mlfq and if UNLOCK_REQURE, 
 // then put the process to the very front of L0 queue (tail of L0 queue)
+// While LOCKED, only the locked process stays out of the queue,
+// processes of other cpus go back to the queue as usual.
 void
 back_to_mlfq(MLFQ* mlfq, struct proc* p) {
   //cprintf("back to mlfq\n");
-  if (mlfq->state == LOCKED) {
+  sync_boost(mlfq, p);
+  p->mlfq_stat.runnable_since = ticks;
+
+  if (mlfq->state == LOCKED && p == mlfq->locked_proc) {
+    (p->mlfq_stat.lock_ticks)++;
     (p->mlfq_info.tick_left)--;
     return;
   }
   
   if (mlfq->state == UNLOCK_REQUIRE) {
-    push_tail(&(mlfq->sched_queue[L0]), p);
+    push_rr_queue(get_run_queue(mlfq, p), p, TRUE);
     mlfq->state = IDLE;
     return;
   }
@@ -363,10 +670,13 @@ back_to_mlfq(MLFQ* mlfq, struct proc* p) {
     }
     
     (p->mlfq_info.tick_left)--;
+    (p->mlfq_stat.ticks[p->mlfq_info.level])++;
     
     if (p->mlfq_info.tick_left == 0) { // Used all time quantum, move to lower queue
       if (p->mlfq_info.level == L0 || p->mlfq_info.level == L1) {
         (p->mlfq_info.level)++;
+        (p->mlfq_stat.ndemote)++;
+        log_sched_event(SCHEDEV_DEMOTE, p);
         insert_queue(mlfq, p, p->mlfq_info.level, FALSE, TRUE);
       } else if (p->mlfq_info.level == L2) {
         if (p->mlfq_info.priority.pvalue > 0) {
@@ -374,16 +684,16 @@ back_to_mlfq(MLFQ* mlfq, struct proc* p) {
         }
         // L2 to L2 so just set time quantum and push to L2 queue
         p->mlfq_info.tick_left = mlfq->MAX_TIME_QUANTUM[L2];
-        push_by_priority(&(mlfq->sched_queue[L2]), p); 
+        push_by_priority(get_run_queue(mlfq, p), p);
       } else {
         print_mlfq_err(mlfq, p);
         panic("Process has wrong level!");
       }
     } else { // time quantum has left, push into same level queue
       if (p->mlfq_info.level == L0 || p->mlfq_info.level == L1) {
-        push_head(&(mlfq->sched_queue[p->mlfq_info.level]), p);
+        push_rr_queue(get_run_queue(mlfq, p), p, FALSE);
       } else if (p->mlfq_info.level == L2) {
-        push_by_priority(&(mlfq->sched_queue[L2]), p);
+        push_by_priority(get_run_queue(mlfq, p), p);
       } else {
         print_mlfq_err(mlfq, p);
         panic("Process has wrong level!");
@@ -419,6 +729,8 @@ relocate_by_priority(MLFQ* mlfq, int pid, int priority) {
     return;
   }
 
+  sync_boost(mlfq, target_proc);
+
   if (target_proc->state != RUNNABLE && target_proc->state != SLEEPING) {
     if (target_proc->state == RUNNING){ // process can be running by other cpu
       target_proc->mlfq_info.priority.pvalue = priority;
@@ -429,28 +741,35 @@ relocate_by_priority(MLFQ* mlfq, int pid, int priority) {
     return;
   }
 
-  // set priority
-  target_proc->mlfq_info.priority.pvalue = priority;
-
-  // if the process in L2 queue then first take out the process from queue and put back
-  if (target_proc->mlfq_info.level == L2 && target_proc->state == RUNNABLE) {
+  // if the process in L2 queue then first take out the process from the bucket of old priority
+  // and put back to the bucket of new priority
+  // (locked process is RUNNABLE but not in the queue)
+  if (target_proc->mlfq_info.level == L2 && target_proc->state == RUNNABLE && target_proc != mlfq->locked_proc) {
     delete_from_queue(mlfq, target_proc, TRUE);
-    push_by_priority(&(mlfq->sched_queue[L2]), target_proc);
-  } 
+    target_proc->mlfq_info.priority.pvalue = priority;
+    push_by_priority(get_run_queue(mlfq, target_proc), target_proc);
+  } else {
+    target_proc->mlfq_info.priority.pvalue = priority;
+  }
 }
 
-// This function will be called for every 100 ticks by boost_check function
+// This function will be called for every boost_period ticks by boost_check function
 //
-// Put every process into L0 queue
+// Put every process into L0 queue of its run queue (boost is done for every cpu at once)
 // and if mlfq state is LOCKED then first put the locked process 
 // to the very front of L0 queue (tail of L0 queue)
+//
+// Queues are moved to L0 queue as a whole, and the level, priority and time quantum
+// of each process are reset later by sync_boost, so boost doesn't iterate processes.
 void
 prirority_boost(MLFQ* mlfq) {
   struct proc* target_proc;
-  struct proc* iter_ptr;
+  RunQueue* rq;
+  int pvalue;
+  int c;
 
-  QList* L1Q_ptr = &(mlfq->sched_queue[L1]);
-  QList* L2Q_ptr = &(mlfq->sched_queue[L2]);
+  (mlfq->boost_epoch)++;
+  log_sched_event(SCHEDEV_BOOST, NULL_);
   
   // Unlock the scheduler and put the locked process in to L0 queue
   if (mlfq->state == LOCKED) {
@@ -460,53 +779,72 @@ prirority_boost(MLFQ* mlfq) {
     target_proc = mlfq->locked_proc;
     mlfq->locked_proc = NULL_;
 
-    target_proc->mlfq_info.level = L0;
-    target_proc->mlfq_info.priority.pvalue = MLFQMAXPRIORIY;
-    target_proc->mlfq_info.tick_left = mlfq->MAX_TIME_QUANTUM[L0];
-
-    push_tail(&(mlfq->sched_queue[L0]), target_proc); // very front of L0 queue
-  }
-
-  while (L1Q_ptr->head != NULL_) { // take all process from L1 queue and put back in to L0 queue 
-    target_proc = pop_tail(L1Q_ptr);
-    insert_queue(mlfq, target_proc, L0, TRUE, TRUE);
+    sync_boost(mlfq, target_proc);
+    log_sched_event(SCHEDEV_UNLOCK, target_proc);
+    // a running locked process is queued by back_to_mlfq when it yields
+    if (target_proc->state == RUNNABLE) {
+      push_rr_queue(get_run_queue(mlfq, target_proc), target_proc, TRUE); // very front of L0 queue
+    }
   }
 
-  while (L2Q_ptr->head != NULL_) { // take all process from L12queue and put back in to L0 queue 
-    target_proc = pop_tail(L2Q_ptr);
-    insert_queue(mlfq, target_proc, L0, TRUE, TRUE);
-  }
+  for (c = 0; c < ncpu; c++) {
+    rq = &(mlfq->run_queue[c]);
 
-  // iter all process in ptable and initialize every process to make it sure
-  for (iter_ptr = mlfq->ptable_ptr; iter_ptr < &((mlfq->ptable_ptr)[NPROC]); iter_ptr++) {
-    if (iter_ptr->state == RUNNABLE || iter_ptr->state == RUNNING || iter_ptr->state == SLEEPING) {
-      iter_ptr->mlfq_info.level = L0;
-      iter_ptr->mlfq_info.priority.pvalue = MLFQMAXPRIORIY;
-      iter_ptr->mlfq_info.tick_left = mlfq->MAX_TIME_QUANTUM[L0];
+    // L0 <- L1 <- L2 (from the highest priority) order, same as popping one by one
+    splice_head(&(rq->sched_queue[L0]), &(rq->sched_queue[L1]));
+    for (pvalue = 0; pvalue <= MLFQMAXPRIORIY; pvalue++) {
+      splice_head(&(rq->sched_queue[L0]), &(rq->l2_bucket[pvalue]));
     }
+
+    rq->l2_bucket_mask = 0;
+    rq->level_mask = (rq->nqueued != 0) ? (1 << L0) : 0;
   }
 }
 
-// Increase global tick and check if it overs 100 for every tick
-// Will be called by scheduler
-// If the global tick over 100 ticks, then call priority_boost and set global tick to 0
+// Check if the boost deadline has passed
+// Will be called by timer interrupt for every tick (see check_boost in proc.c)
+// If ticks reached the deadline, then call priority_boost and set the next deadline
 void 
 boost_check(MLFQ* mlfq) {
-  // mlfq->global_tick++;
-  
-  // if (mlfq->global_tick >= 100) {
-  //   cprintf("boost\n");
-  //   mlfq->global_tick = 0;
-  //   prirority_boost(mlfq);
-  // }
-
-  if (boost_flag == TRUE) {
+  if (ticks >= mlfq->boost_deadline) {
     // cprintf("boost\n");
-    boost_flag = FALSE;
+    mlfq->boost_deadline = ticks + mlfq->boost_period;
     prirority_boost(mlfq);
   }
 }
 
+// Return TRUE if there's nothing to schedule on any cpu.
+// While LOCKED, only the gang of the locked process can be scheduled.
+// Can be called without ptable.lock, the result is just a hint for the idle cpu
+// and it will be checked again after the next interrupt.
+int
+mlfq_is_idle(MLFQ* mlfq) {
+  int i;
+  struct proc* iter_ptr;
+  struct proc* locked = mlfq->locked_proc; // read once, it can be changed by other cpu
+
+  if (mlfq->state == LOCKED && locked != NULL_) {
+    for (iter_ptr = mlfq->ptable_ptr; iter_ptr < &((mlfq->ptable_ptr)[NPROC]); iter_ptr++) {
+      if (iter_ptr->state == RUNNABLE && in_gang(locked, iter_ptr)) {
+        return FALSE;
+      }
+    }
+    return TRUE;
+  }
+
+  if (mlfq->state != IDLE) {
+    return FALSE;
+  }
+
+  for (i = 0; i < ncpu; i++) {
+    if (mlfq->run_queue[i].nqueued != 0) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
 //TODO: exit, sleep 할때도 자동 unlock 해줘야함
 // Just change the state of mlfq and set the target process as locked process
 // return -1 when fail
@@ -518,10 +856,14 @@ scheduler_lock(MLFQ* mlfq, struct proc* target_proc) {
     return -1;
   }
 
+  sync_boost(mlfq, target_proc);
+
   mlfq->state = LOCKED;
   ticks = 0;
+  mlfq->boost_deadline = mlfq->boost_period; // ticks restarted from 0
   mlfq->locked_proc = target_proc;
   target_proc->mlfq_info.tick_left = 100;
+  log_sched_event(SCHEDEV_LOCK, target_proc);
   return 0;
 }
 
@@ -545,9 +887,10 @@ scheduler_unlock(MLFQ* mlfq) {
   target_proc = mlfq->locked_proc;
   mlfq->locked_proc = NULL_;
 
-  target_proc->mlfq_info.priority.pvalue = MLFQMAXPRIORIY; // priority value as 3
+  target_proc->mlfq_info.priority.pvalue = mlfq->max_priority; // priority value as 3 by default
   target_proc->mlfq_info.tick_left = mlfq->MAX_TIME_QUANTUM[L0]; // max time quantum of L0
   target_proc->mlfq_info.level = L0;
+  log_sched_event(SCHEDEV_UNLOCK, target_proc);
   return 0;
 }
 
@@ -570,8 +913,114 @@ check_lock_state_when_sched(MLFQ* mlfq, struct proc* p) {
   }
 }
 
+// Return the wait list of sleep_hash for the chan.
+QList*
+get_sleep_queue(MLFQ* mlfq, void* chan) {
+  uint key = (uint)chan;
+
+  return &(mlfq->sleep_hash[(key ^ (key >> 6) ^ (key >> 12)) % NSLEEPHASH]);
+}
+
+// Put the sleeping process into the wait list of its chan.
+// A sleeping process is never in the run queue, so the links of mlfq_info are used.
+void
+insert_sleep_queue(MLFQ* mlfq, struct proc* p) {
+  push_tail(get_sleep_queue(mlfq, p->chan), p);
+}
+
+// Wake up all processes sleeping on chan.
+// Only the wait list of the chan is visited instead of the whole ptable.
+void
+wakeup_sleep_queue(MLFQ* mlfq, void* chan) {
+  struct proc* p;
+  struct proc* next;
+
+  for (p = get_sleep_queue(mlfq, chan)->head; p != NULL_; p = next) {
+    next = p->mlfq_info.next; // check_wakeup relinks p into the run queue
+    if (p->state == SLEEPING && p->chan == chan) {
+      p->state = RUNNABLE;
+      check_wakeup(mlfq, p);
+    }
+  }
+}
+
 // If the process waked up, it should go back to mlfq
+// (take it out of the wait list first)
 void
 check_wakeup(MLFQ* mlfq, struct proc* p) {
+  unlink_elem(get_sleep_queue(mlfq, p->chan), p);
+  sync_boost(mlfq, p);
   insert_queue(mlfq, p, p->mlfq_info.level, FALSE, TRUE);
+  log_sched_event(SCHEDEV_WAKEUP, p);
+}
+
+// Copy current parameters of mlfq.
+void
+get_mlfq_params(MLFQ* mlfq, MLFQParams* params) {
+  int i;
+
+  for (i = 0; i < NMLFQLEVEL; i++) {
+    params->time_quantum[i] = mlfq->MAX_TIME_QUANTUM[i];
+  }
+  params->boost_period = mlfq->boost_period;
+  params->max_priority = mlfq->max_priority;
+}
+
+// Change the parameters of mlfq.
+// Processes already in mlfq are adjusted to the new parameters:
+// - time quantum left is cut to the new time quantum of its level
+// - priority value bigger than new max priority becomes max priority
+//   (and moves to the bucket of new priority value if it is in L2 queue)
+// - next boost happens boost_period ticks later from now
+//
+// return -1 when a parameter is out of range
+int
+set_mlfq_params(MLFQ* mlfq, MLFQParams* params) {
+  int i;
+  struct proc* iter_ptr;
+
+  for (i = 0; i < NMLFQLEVEL; i++) {
+    if (params->time_quantum[i] < 1 || params->time_quantum[i] > MLFQMAXTIMEQ) {
+      return -1;
+    }
+  }
+  if (params->boost_period < 1 || params->boost_period > MLFQMAXBOOSTTIME) {
+    return -1;
+  }
+  if (params->max_priority < 0 || params->max_priority > MLFQMAXPRIORIY) {
+    return -1;
+  }
+
+  for (i = 0; i < NMLFQLEVEL; i++) {
+    mlfq->MAX_TIME_QUANTUM[i] = params->time_quantum[i];
+  }
+  mlfq->boost_period = params->boost_period;
+  mlfq->boost_deadline = ticks + mlfq->boost_period;
+  mlfq->max_priority = params->max_priority;
+
+  for (iter_ptr = mlfq->ptable_ptr; iter_ptr < &((mlfq->ptable_ptr)[NPROC]); iter_ptr++) {
+    if (iter_ptr->state != RUNNABLE && iter_ptr->state != RUNNING && iter_ptr->state != SLEEPING) {
+      continue;
+    }
+
+    sync_boost(mlfq, iter_ptr);
+
+    if (iter_ptr != mlfq->locked_proc // locked process uses its own time quantum
+        && iter_ptr->mlfq_info.level >= 0
+        && iter_ptr->mlfq_info.tick_left > mlfq->MAX_TIME_QUANTUM[iter_ptr->mlfq_info.level]) {
+      iter_ptr->mlfq_info.tick_left = mlfq->MAX_TIME_QUANTUM[iter_ptr->mlfq_info.level];
+    }
+
+    if (iter_ptr->mlfq_info.priority.pvalue > mlfq->max_priority) {
+      if (iter_ptr->mlfq_info.level == L2 && iter_ptr->state == RUNNABLE && iter_ptr != mlfq->locked_proc) {
+        delete_from_queue(mlfq, iter_ptr, TRUE);
+        iter_ptr->mlfq_info.priority.pvalue = mlfq->max_priority;
+        push_by_priority(get_run_queue(mlfq, iter_ptr), iter_ptr);
+      } else {
+        iter_ptr->mlfq_info.priority.pvalue = mlfq->max_priority;
+      }
+    }
+  }
+
+  return 0;
 }
\ No newline at end of file
@@ -9,14 +9,29 @@ typedef struct _QList {
   struct proc* tail;               // NULL_ when queue is empty
 } QList;
 
+// L0~L2 queue of a cpu
+typedef struct _RunQueue {
+  QList sched_queue[L2];           // Linked list for L0, L1 queue
+  QList l2_bucket[MLFQMAXPRIORIY + 1]; // L2 queue, one FIFO per priority value (ordered by enter_id)
+  uint level_mask;                 // bit i is set when level i has a process to schedule
+  uint l2_bucket_mask;             // bit i is set when l2_bucket[i] is not empty
+  int nqueued;                     // number of processes in this run queue
+} RunQueue;
+
 typedef struct _MLFQ {
-  const int MAX_TIME_QUANTUM[NMLFQLEVEL];
+  int MAX_TIME_QUANTUM[NMLFQLEVEL];  // can be changed by setmlfqparams
+  int boost_period;                // ticks between priority boosts
+  int max_priority;                // priority value of new process, L2 priority range is 0 ~ max_priority
 
   MLFQState state;                 // if scheduler locked(LOCKED) or not(IDLE)
   struct proc* ptable_ptr;         // implement queue as linked list
 
-  QList sched_queue[NMLFQLEVEL];   // Linked list for L0~L2 queue
-  int l2q_enter_id;                // increase 1 when new process enter, 0 is default
+  RunQueue run_queue[NCPU];        // each cpu schedules from its own run queue
+  int l2q_enter_id;                // increase 1 when new process enter, 0 is default (shared by all cpus)
+  uint boost_deadline;             // priority boost happens when ticks reaches this value
+  uint boost_epoch;                // increase 1 for every priority boost
+
+  QList sleep_hash[NSLEEPHASH];    // wait lists of sleeping processes, hashed by chan
 
   struct proc* locked_proc;        // process that has called schedulerLock()
-} MLFQ;
\ No newline at end of file
+} MLFQ;
@@ -0,0 +1,380 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "fcntl.h"
+#include "mlfqstat.h"
+#include "mlfqparams.h"
+
+// Scheduler benchmark for mlfq
+//
+// usage: schedbench [hogs sleepers yielders churners lockers]
+//   hogs      CPU bound loop
+//   sleepers  interactive process, sleep and do a little work repeatedly
+//   yielders  CPU bound loop calling yield frequently
+//   churners  CPU bound loop changing priority of itself and other workers
+//   lockers   CPU bound loop holding schedulerLock for a short burst
+//
+// Every CPU bound worker does the same amount of work, so with a fair scheduler
+// they should finish at about the same time.
+//
+// Lockers take turns through a pipe holding a single token,
+// since schedulerLock fails while another process holds the lock.
+// The kernel exits a locker whose lock was released by a boost before schedulerUnlock,
+// so the parent puts the token back when it reaps a locker without a result.
+// Each worker leaves its result in a file (see result_name), since the parent
+// finds out about such a locker only by wait.
+//
+// reports (time is in ticks, of monotime since schedulerLock resets uptime)
+//   turnaround        time from fork to the end of work of CPU bound workers
+//   response          time from fork to the first run of every worker,
+//                     and the delay of wakeup after sleep of sleepers
+//   context switches  how many times workers were scheduled per second
+//   fairness          Jain's fairness index of the turnaround of CPU bound workers
+
+#define NWORKER       32
+#define NKIND         5
+#define MAXRESP       32          // response time samples per worker
+
+#define WORK          200         // work units of CPU bound worker
+#define WORK_LOOP     100000      // loop count of a work unit
+#define SLEEP_ROUND   20          // rounds of sleeper
+#define SLEEP_TICKS   3           // sleep time of a round
+#define YIELD_EVERY   1000        // yielders yield every YIELD_EVERY loops
+#define CHURN_EVERY   10          // churners change priority every CHURN_EVERY work units
+#define LOCK_EVERY    50          // lockers hold the lock every LOCK_EVERY work units
+#define LOCK_WORK     5           // work units done while holding the lock
+
+#define LOCK_PASSWORD 2019039843
+
+enum { HOG = 0, SLEEPER, YIELDER, CHURNER, LOCKER };
+
+char* kind_names[NKIND] = { "hog", "sleeper", "yielder", "churner", "locker" };
+
+typedef struct _Result {
+  int kind;
+  int pid;
+  int turnaround;
+  int nsched;
+  int nresp;
+  int resp[MAXRESP + 1];
+} Result;
+
+int worker_pids[NWORKER];
+int worker_kinds[NWORKER];
+int nworker;
+int fork_tick;              // set right before fork, so the child knows it too
+int lock_fds[2];            // token of lockers
+MLFQParams params;          // read before fork, churners use max_priority
+
+Result results[NWORKER];
+int resp_all[NWORKER * (MAXRESP + 1)];
+MLFQStat stat_list[NPROC];
+
+volatile int sink;
+
+void
+work_unit(int yield_every) {
+  int i;
+
+  for (i = 0; i < WORK_LOOP; i++) {
+    sink += i;
+    if (yield_every > 0 && i % yield_every == 0) {
+      yield();
+    }
+  }
+}
+
+// number of times the process was scheduled
+int
+get_nsched(int pid) {
+  int num, i;
+
+  if (getmlfqstat(stat_list, &num) < 0) {
+    return 0;
+  }
+  for (i = 0; i < num; i++) {
+    if (stat_list[i].pid == pid) {
+      return stat_list[i].nsched;
+    }
+  }
+  return 0;
+}
+
+// name of the result file of the worker of index
+void
+result_name(char* name, int index) {
+  strcpy(name, "sbres00");
+  name[5] = '0' + index / 10;
+  name[6] = '0' + index % 10;
+}
+
+void
+run_worker(int kind, int index) {
+  Result r;
+  int i, fd, before;
+  int npriority = params.max_priority + 1;
+  char token;
+  char name[8];
+
+  memset(&r, 0, sizeof(r));
+  r.kind = kind;
+  r.pid = getpid();
+  r.resp[r.nresp++] = monotime() - fork_tick; // first run
+
+  switch (kind) {
+  case HOG:
+    for (i = 0; i < WORK; i++) {
+      work_unit(0);
+    }
+    break;
+  case SLEEPER:
+    for (i = 0; i < SLEEP_ROUND; i++) {
+      before = monotime();
+      sleep(SLEEP_TICKS);
+      if (r.nresp <= MAXRESP) {
+        r.resp[r.nresp++] = monotime() - before - SLEEP_TICKS;
+      }
+      work_unit(0);
+    }
+    break;
+  case YIELDER:
+    for (i = 0; i < WORK; i++) {
+      work_unit(YIELD_EVERY);
+    }
+    break;
+  case CHURNER:
+    for (i = 0; i < WORK; i++) {
+      if (i % CHURN_EVERY == 0) {
+        // priorities in the range of max_priority set at runtime, so every call takes effect
+        setPriority(r.pid, i % npriority);
+        if (index > 0) {
+          setPriority(worker_pids[i % index], (i / CHURN_EVERY) % npriority);
+        }
+      }
+      work_unit(0);
+    }
+    break;
+  case LOCKER:
+    for (i = 0; i < WORK; i++) {
+      if (i % LOCK_EVERY == 0) {
+        read(lock_fds[0], &token, 1);
+        schedulerLock(LOCK_PASSWORD);
+      }
+      work_unit(0);
+      if (i % LOCK_EVERY == LOCK_WORK) {
+        schedulerUnlock(LOCK_PASSWORD);
+        write(lock_fds[1], &token, 1);
+      }
+    }
+    break;
+  }
+
+  r.turnaround = monotime() - fork_tick;
+  r.nsched = get_nsched(r.pid);
+
+  result_name(name, index);
+  if ((fd = open(name, O_CREATE | O_WRONLY)) >= 0) {
+    write(fd, &r, sizeof(r));
+    close(fd);
+  }
+  exit();
+}
+
+// read the result of the worker of index, and remove its file
+// return 0 when success, -1 when the worker left no result
+int
+read_result(int index, Result* r) {
+  char name[8];
+  int fd, n;
+
+  result_name(name, index);
+  if ((fd = open(name, O_RDONLY)) < 0) {
+    return -1;
+  }
+  n = read(fd, r, sizeof(Result));
+  close(fd);
+  unlink(name);
+  return n == sizeof(Result) ? 0 : -1;
+}
+
+void
+sort(int* arr, int n) {
+  int i, j, temp;
+
+  for (i = 1; i < n; i++) {
+    temp = arr[i];
+    for (j = i - 1; j >= 0 && arr[j] > temp; j--) {
+      arr[j + 1] = arr[j];
+    }
+    arr[j + 1] = temp;
+  }
+}
+
+// Jain's fairness index (sum x)^2 / (n * sum x^2), returned multiplied by 1000
+// Computed in integers, since the kernel doesn't save FPU state across context switches.
+// x is scaled to 0 ~ 1000 of its maximum first, so the sums fit in uint.
+int
+jain_index(int* x, int n) {
+  uint sum = 0, sq_sum = 0, max = 0;
+  uint v, num, den, q, r;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if (x[i] > max) {
+      max = x[i];
+    }
+  }
+  if (n == 0 || max == 0) {
+    return 1000;
+  }
+  for (i = 0; i < n; i++) {
+    v = x[i] * 1000 / max;
+    sum += v;
+    sq_sum += v * v;
+  }
+
+  num = sum * sum;
+  den = n * sq_sum;
+  while (den >= (1 << 28)) { // so that r * 10 below doesn't overflow
+    num >>= 1;
+    den >>= 1;
+  }
+  // num * 1000 / den, a digit at a time
+  q = num / den;
+  r = num % den;
+  for (i = 0; i < 3; i++) {
+    r *= 10;
+    q = q * 10 + r / den;
+    r %= den;
+  }
+  return q;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int count[NKIND] = { 4, 2, 2, 1, 0 };
+  int i, k, n, pid, nmissing, start, elapsed, nresp, ncpu_bound, nsched;
+  int turnaround[NWORKER];
+  int sum_turnaround, max_turnaround;
+  char name[8];
+
+  if (argc != 1 && argc != NKIND + 1) {
+    printf(2, "usage: schedbench [hogs sleepers yielders churners lockers]\n");
+    exit();
+  }
+  if (argc == NKIND + 1) {
+    for (k = 0; k < NKIND; k++) {
+      count[k] = atoi(argv[k + 1]);
+    }
+  }
+  for (k = 0, n = 0; k < NKIND; k++) {
+    n += count[k];
+  }
+  if (n <= 0 || n > NWORKER) {
+    printf(2, "schedbench: number of workers should be 1 ~ %d\n", NWORKER);
+    exit();
+  }
+
+  printf(1, "schedbench: hog %d, sleeper %d, yielder %d, churner %d, locker %d\n",
+    count[HOG], count[SLEEPER], count[YIELDER], count[CHURNER], count[LOCKER]);
+
+  if (getmlfqparams(&params) < 0) {
+    printf(2, "schedbench: getmlfqparams failed\n");
+    exit();
+  }
+  if (pipe(lock_fds) < 0) {
+    printf(2, "schedbench: pipe failed\n");
+    exit();
+  }
+  write(lock_fds[1], "t", 1);
+  for (i = 0; i < NWORKER; i++) { // results left by an interrupted run
+    result_name(name, i);
+    unlink(name);
+  }
+
+  start = monotime();
+  nworker = 0;
+  for (k = 0; k < NKIND; k++) {
+    for (i = 0; i < count[k]; i++) {
+      fork_tick = monotime();
+      worker_kinds[nworker] = k;
+      worker_pids[nworker] = fork();
+      if (worker_pids[nworker] < 0) {
+        printf(2, "schedbench: fork failed\n");
+        exit();
+      }
+      if (worker_pids[nworker] == 0) {
+        run_worker(k, nworker);
+      }
+      nworker++;
+    }
+  }
+  close(lock_fds[0]);
+
+  n = 0;
+  nmissing = 0;
+  while ((pid = wait()) != -1) {
+    for (i = 0; i < nworker && worker_pids[i] != pid; i++)
+      ;
+    if (i == nworker) {
+      continue;
+    }
+    if (read_result(i, &results[n]) == 0) {
+      n++;
+      continue;
+    }
+    nmissing++;
+    if (worker_kinds[i] == LOCKER) {
+      write(lock_fds[1], "t", 1); // it exited holding the token
+    }
+  }
+  close(lock_fds[1]);
+  if (nmissing > 0) {
+    printf(2, "schedbench: %d workers exited without a result\n", nmissing);
+  }
+  nworker = n;
+  elapsed = monotime() - start;
+
+  nresp = 0;
+  ncpu_bound = 0;
+  nsched = 0;
+  sum_turnaround = 0;
+  max_turnaround = 0;
+  for (i = 0; i < nworker; i++) {
+    for (k = 0; k < results[i].nresp; k++) {
+      resp_all[nresp++] = results[i].resp[k];
+    }
+    nsched += results[i].nsched;
+
+    if (results[i].kind != SLEEPER) {
+      turnaround[ncpu_bound++] = results[i].turnaround;
+      sum_turnaround += results[i].turnaround;
+      if (results[i].turnaround > max_turnaround) {
+        max_turnaround = results[i].turnaround;
+      }
+    }
+
+    printf(1, "  pid %d %s: turnaround %d, scheduled %d\n",
+      results[i].pid, kind_names[results[i].kind], results[i].turnaround, results[i].nsched);
+  }
+  sort(resp_all, nresp);
+
+  printf(1, "elapsed: %d ticks\n", elapsed);
+  if (ncpu_bound > 0) {
+    printf(1, "turnaround: avg %d, max %d\n", sum_turnaround / ncpu_bound, max_turnaround);
+  }
+  if (nresp > 0) {
+    printf(1, "response: p50 %d, p90 %d, p99 %d, max %d\n",
+      resp_all[nresp * 50 / 100], resp_all[nresp * 90 / 100],
+      resp_all[nresp * 99 / 100], resp_all[nresp - 1]);
+  }
+  if (elapsed > 0) {
+    printf(1, "context switches: %d per second\n", nsched * 100 / elapsed);
+  }
+  k = jain_index(turnaround, ncpu_bound);
+  printf(1, "fairness: %d.%d%d%d\n", k / 1000, (k / 100) % 10, (k / 10) % 10, k % 10);
+
+  exit();
+}
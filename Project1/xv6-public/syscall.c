@@ -109,6 +109,11 @@ extern int sys_getLevel(void);
 extern int sys_setPriority(void);
 extern int sys_schedulerLock(void);
 extern int sys_schedulerUnlock(void);
+extern int sys_getmlfqstat(void);
+extern int sys_getschedlog(void);
+extern int sys_getmlfqparams(void);
+extern int sys_setmlfqparams(void);
+extern int sys_monotime(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -138,6 +143,11 @@ static int (*syscalls[])(void) = {
 [SYS_setPriority] sys_setPriority,
 [SYS_schedulerLock] sys_schedulerLock,
 [SYS_schedulerUnlock] sys_schedulerUnlock,
+[SYS_getmlfqstat] sys_getmlfqstat,
+[SYS_getschedlog] sys_getschedlog,
+[SYS_getmlfqparams] sys_getmlfqparams,
+[SYS_setmlfqparams] sys_setmlfqparams,
+[SYS_monotime] sys_monotime,
 };
 
 void
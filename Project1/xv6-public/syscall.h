@@ -26,4 +26,9 @@
 #define SYS_getLevel 24
 #define SYS_setPriority 25
 #define SYS_schedulerLock 26
-#define SYS_schedulerUnlock 27
\ No newline at end of file
+#define SYS_schedulerUnlock 27
+#define SYS_getmlfqstat 28
+#define SYS_getschedlog 29
+#define SYS_getmlfqparams 30
+#define SYS_setmlfqparams 31
+#define SYS_monotime 32
\ No newline at end of file
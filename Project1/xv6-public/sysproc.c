@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "mlfqstat.h"
+#include "mlfqparams.h"
 
 //------------------implemented by me(Yu, Taehwan) for assignment -------------------
 
@@ -19,7 +21,7 @@ sys_yield(void)
 int
 sys_getLevel(void)
 {
-  return myproc()->mlfq_info.level;
+  return getLevel();
 }
 
 int
@@ -59,6 +61,70 @@ sys_schedulerUnlock(void)
   return 0;
 }
 
+int
+sys_getmlfqstat(void)
+{
+  MLFQStat* stat_list;
+  int* num;
+
+  if (argptr(0, (void*)&stat_list, sizeof(MLFQStat) * NPROC) < 0) {
+    return -1;
+  }
+
+  if (argptr(1, (void*)&num, sizeof(int)) < 0) {
+    return -1;
+  }
+
+  mlfqstat(stat_list, num);
+
+  return 0;
+}
+
+int
+sys_getschedlog(void)
+{
+  SchedEvent* events;
+  int* num;
+
+  if (argptr(0, (void*)&events, sizeof(SchedEvent) * NSCHEDEVENT) < 0) {
+    return -1;
+  }
+
+  if (argptr(1, (void*)&num, sizeof(int)) < 0) {
+    return -1;
+  }
+
+  schedlog(events, num);
+
+  return 0;
+}
+
+int
+sys_getmlfqparams(void)
+{
+  MLFQParams* params;
+
+  if (argptr(0, (void*)&params, sizeof(MLFQParams)) < 0) {
+    return -1;
+  }
+
+  getmlfqparams(params);
+
+  return 0;
+}
+
+int
+sys_setmlfqparams(void)
+{
+  MLFQParams* params;
+
+  if (argptr(0, (void*)&params, sizeof(MLFQParams)) < 0) {
+    return -1;
+  }
+
+  return setmlfqparams(params);
+}
+
 //------------------implemented by me(Yu, Taehwan) for assignment -------------------
 
 int
@@ -114,18 +180,19 @@ int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
   acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
+  if(n > 0)
+    add_timer(myproc(), n); // woken up only when the timer expires
+  while(timer_pending(myproc())){
     if(myproc()->killed){
+      del_timer(myproc());
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    sleep(&myproc()->sleep_timer, &tickslock);
   }
   release(&tickslock);
   return 0;
@@ -143,3 +210,16 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// return clock ticks since start like uptime,
+// but not reset by schedulerLock.
+int
+sys_monotime(void)
+{
+  uint xticks;
+
+  acquire(&tickslock);
+  xticks = timer_now();
+  release(&tickslock);
+  return xticks;
+}
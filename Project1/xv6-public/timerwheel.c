@@ -0,0 +1,127 @@
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+// Hierarchical timer wheel for sleep system call, protected by tickslock
+//
+// slot[0][i] : timers that expire at tick t where t % NTIMERSLOT == i (within NTIMERSLOT ticks)
+// slot[1][i] : timers that expire at tick t where (t / NTIMERSLOT) % NTIMERSLOT == i
+//              (within NTIMERSLOT * NTIMERSLOT ticks)
+//
+// When the clock crosses a multiple of NTIMERSLOT, the timers of matching slot[1] are moved down to slot[0].
+// Timers farther than NTIMERSLOT * NTIMERSLOT ticks wait in the last slot of slot[1]
+// and are placed again every time they are cascaded.
+// A sleeping process is woken up only once, when its timer expires.
+//
+// The wheel keeps its own clock instead of ticks, because schedulerLock resets ticks to 0.
+struct {
+  struct proc* slot[2][NTIMERSLOT];  // doubly linked list of processes, NULL_ when empty
+  uint now;                          // increase 1 for every tick
+} timer_wheel;
+
+// Return the slot the timer should be put into, as seen from now.
+struct proc**
+get_timer_slot(uint expires, uint now) {
+  uint delta = expires - now;
+
+  if (delta < NTIMERSLOT) {
+    return &(timer_wheel.slot[0][expires % NTIMERSLOT]);
+  }
+  if (delta < NTIMERSLOT * NTIMERSLOT) {
+    return &(timer_wheel.slot[1][(expires / NTIMERSLOT) % NTIMERSLOT]);
+  }
+  return &(timer_wheel.slot[1][(now / NTIMERSLOT + NTIMERSLOT - 1) % NTIMERSLOT]);
+}
+
+// Put the process into the head of the slot.
+void
+link_timer(struct proc** slot, struct proc* p) {
+  p->sleep_timer.slot = slot;
+  p->sleep_timer.prev = NULL_;
+  p->sleep_timer.next = *slot;
+  if (*slot != NULL_) {
+    (*slot)->sleep_timer.prev = p;
+  }
+  *slot = p;
+}
+
+// Take out the process from its slot.
+void
+unlink_timer(struct proc* p) {
+  if (p->sleep_timer.next != NULL_) {
+    p->sleep_timer.next->sleep_timer.prev = p->sleep_timer.prev;
+  }
+  if (p->sleep_timer.prev == NULL_) { // if p is head
+    *(p->sleep_timer.slot) = p->sleep_timer.next;
+  } else {
+    p->sleep_timer.prev->sleep_timer.next = p->sleep_timer.next;
+  }
+
+  p->sleep_timer.slot = NULL_;
+  p->sleep_timer.prev = NULL_;
+  p->sleep_timer.next = NULL_;
+}
+
+// Set the timer of the process which wakes it up n ticks later.
+// tickslock must be held.
+void
+add_timer(struct proc* p, uint n) {
+  p->sleep_timer.expires = timer_wheel.now + n;
+  link_timer(get_timer_slot(p->sleep_timer.expires, timer_wheel.now), p);
+}
+
+// Return TRUE if the timer of the process hasn't expired yet.
+// tickslock must be held.
+int
+timer_pending(struct proc* p) {
+  return p->sleep_timer.slot != NULL_;
+}
+
+// Cancel the timer of the process if it hasn't expired yet.
+// tickslock must be held.
+void
+del_timer(struct proc* p) {
+  if (p->sleep_timer.slot != NULL_) {
+    unlink_timer(p);
+  }
+}
+
+// Called for every tick.
+// Move the timers of slot[1] down if needed, and wake up the processes whose timer expired.
+// tickslock must be held.
+void
+expire_timers(void) {
+  struct proc* p;
+  struct proc* next;
+  struct proc** slot;
+  uint now = ++(timer_wheel.now);
+
+  if (now % NTIMERSLOT == 0) {
+    slot = &(timer_wheel.slot[1][(now / NTIMERSLOT) % NTIMERSLOT]);
+    for (p = *slot; p != NULL_; p = next) {
+      next = p->sleep_timer.next;
+      unlink_timer(p);
+      link_timer(get_timer_slot(p->sleep_timer.expires, now), p);
+    }
+  }
+
+  slot = &(timer_wheel.slot[0][now % NTIMERSLOT]);
+  for (p = *slot; p != NULL_; p = next) {
+    next = p->sleep_timer.next;
+    if (p->sleep_timer.expires == now) {
+      unlink_timer(p);
+      wakeup(&(p->sleep_timer));
+    }
+  }
+}
+
+// Ticks since boot, as counted by the wheel.  Unlike ticks, never reset by schedulerLock.
+// tickslock must be held.
+uint
+timer_now(void) {
+  return timer_wheel.now;
+}
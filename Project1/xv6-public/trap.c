@@ -13,7 +13,6 @@ struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
-int boost_flag = FALSE;
 
 void
 tvinit(void)
@@ -81,10 +80,8 @@ trap(struct trapframe *tf)
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
-      if (ticks % 100 == 0 && ticks != 0) {
-        boost_flag = TRUE;
-      }
-      wakeup(&ticks);
+      expire_timers();
+      check_boost();
       release(&tickslock);
     }
     lapiceoi();
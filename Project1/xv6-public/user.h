@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct _MLFQStat;
+struct _SchedEvent;
+struct _MLFQParams;
 
 // system calls
 int fork(void);
@@ -29,6 +32,11 @@ int getLevel(void);
 void setPriority(int, int);
 void schedulerLock(int);
 void schedulerUnlock(int);
+int getmlfqstat(struct _MLFQStat*, int*);
+int getschedlog(struct _SchedEvent*, int*);
+int getmlfqparams(struct _MLFQParams*);
+int setmlfqparams(struct _MLFQParams*);
+int monotime(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
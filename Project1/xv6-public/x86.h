@@ -117,6 +117,14 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and wait for the next one.
+// sti takes effect after hlt starts, so an interrupt can't slip in between.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -130,6 +138,24 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Index of the least significant set bit. val must not be 0.
+static inline uint
+bsf(uint val)
+{
+  uint idx;
+  asm volatile("bsfl %1,%0" : "=r" (idx) : "rm" (val) : "cc");
+  return idx;
+}
+
+// Index of the most significant set bit. val must not be 0.
+static inline uint
+bsr(uint val)
+{
+  uint idx;
+  asm volatile("bsrl %1,%0" : "=r" (idx) : "rm" (val) : "cc");
+  return idx;
+}
+
 static inline uint
 rcr2(void)
 {
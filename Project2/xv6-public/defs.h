@@ -123,14 +123,22 @@ int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 int             setmemorylimit(int, int);
-void            kill_other_threads();
-void            change_main_to_curthread();
+void            stop_other_threads(void);
+void            release_other_threads(bool);
 void            init_thread_data(struct proc*);
 struct proc*    get_main_thread(struct proc*);
-int             thread_create(thread_t *, void *(*)(void *), void *);
+int             thread_create(thread_t *, void *(*)(void *), void *, int);
 void            thread_exit (void *);
 int             thread_join(thread_t, void**);
+int             tstack_check(uint, uint);
+void            clear_thread_group(void);
+int             init_tls(pde_t*, uint, thread_t);
+int             setaffinity(int, int, int);
 void            proclist(struct _PStat*, int*);
+int             setweight(int, int);
+void            futex_unlink(struct proc*);
+int             futex_wait(int*, int);
+int             futex_wake(int*, int);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -192,7 +200,9 @@ void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             copyuvmrange(pde_t*, pde_t*, uint, uint);
 void            switchuvm(struct proc*);
+void            switchtss(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
@@ -6,25 +6,23 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "tls.h"
 
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
   int i, off;
-  uint argc, sz, sp, ustack[3+MAXARG+1];
+  uint argc, sz, sp, tls, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
-  if (curproc->thread_info.is_main) {
-    kill_other_threads();
-  } else {
-    kill_other_threads();
-    change_main_to_curthread();
-  }
+  // the calling thread goes on as the only thread of the process
+  stop_other_threads();
+  release_other_threads(TRUE);
 
   begin_op();
 
@@ -75,6 +73,12 @@ exec(char *path, char **argv)
   clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
   sp = sz;
 
+  // Thread local storage of the main thread is at the top of the stack.
+  sp -= TLSSIZE;
+  tls = sp;
+  if(init_tls(pgdir, tls, 0) < 0)
+    goto bad;
+
   // Push argument strings, prepare rest of stack in ustack.
   for(argc = 0; argv[argc]; argc++) {
     if(argc >= MAXARG)
@@ -108,12 +112,15 @@ exec(char *path, char **argv)
   curproc->main_stack_page_num = 1;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
+  curproc->tf->gs = (SEG_UTLS << 3) | DPL_USER;
+  curproc->tls = tls;
 
   // set memory limit 0 to make this process has no memory limit
   curproc->memory_limit = 0;
   
   switchuvm(curproc);
   freevm(oldpgdir);
+  clear_thread_group();
   return 0;
 
  bad:
@@ -131,7 +138,7 @@ exec2(char *path, char **argv, int stacksize)
 {
   char *s, *last;
   int i, off;
-  uint argc, sz, sp, ustack[3+MAXARG+1];
+  uint argc, sz, sp, tls, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
@@ -142,12 +149,9 @@ exec2(char *path, char **argv, int stacksize)
     return -1;
   }
 
-  if (curproc->thread_info.is_main) {
-    kill_other_threads();
-  } else {
-    kill_other_threads();
-    change_main_to_curthread();
-  }
+  // the calling thread goes on as the only thread of the process
+  stop_other_threads();
+  release_other_threads(TRUE);
 
   begin_op();
 
@@ -198,6 +202,12 @@ exec2(char *path, char **argv, int stacksize)
   clearpteu(pgdir, (char*)(sz - (stacksize + 1)*PGSIZE));
   sp = sz;
 
+  // Thread local storage of the main thread is at the top of the stack.
+  sp -= TLSSIZE;
+  tls = sp;
+  if(init_tls(pgdir, tls, 0) < 0)
+    goto bad;
+
   // Push argument strings, prepare rest of stack in ustack.
   for(argc = 0; argv[argc]; argc++) {
     if(argc >= MAXARG)
@@ -231,12 +241,15 @@ exec2(char *path, char **argv, int stacksize)
   curproc->main_stack_page_num = stacksize;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
+  curproc->tf->gs = (SEG_UTLS << 3) | DPL_USER;
+  curproc->tls = tls;
 
   // set memory limit 0 to make this process has no memory limit
   curproc->memory_limit = 0;
   
   switchuvm(curproc);
   freevm(oldpgdir);
+  clear_thread_group();
   return 0;
 
  bad:
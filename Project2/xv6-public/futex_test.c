@@ -0,0 +1,118 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+#define NUM_THREAD 5
+#define NUM_INCREASE 2000
+
+int lock;       // 0: unlocked, 1: locked, 2: locked and someone may be waiting
+int counter;
+int flag;
+thread_t thread[NUM_THREAD];
+
+void failed()
+{
+  printf(1, "Test failed!\n");
+  exit();
+}
+
+void mutex_lock(int *m)
+{
+  if (xchg((uint*)m, 1) == 0)
+    return;
+  while (xchg((uint*)m, 2) != 0)
+    futex_wait(m, 2);
+}
+
+void mutex_unlock(int *m)
+{
+  if (xchg((uint*)m, 0) == 2)
+    futex_wake(m, 1);
+}
+
+void *thread_increase(void *arg)
+{
+  int i, temp;
+
+  for (i = 0; i < NUM_INCREASE; i++) {
+    mutex_lock(&lock);
+    temp = counter;
+    if (i % 100 == 0)
+      sleep(1); // let other threads contend for the lock
+    counter = temp + 1;
+    mutex_unlock(&lock);
+  }
+  thread_exit(arg);
+  return 0;
+}
+
+void *thread_waiter(void *arg)
+{
+  while (flag == 0)
+    futex_wait(&flag, 0);
+  thread_exit(arg);
+  return 0;
+}
+
+void create_all(void *(*start_routine)(void *))
+{
+  int i;
+  for (i = 0; i < NUM_THREAD; i++) {
+    if (thread_create(&thread[i], start_routine, (void*)i) != 0) {
+      printf(1, "Error creating thread %d\n", i);
+      failed();
+    }
+  }
+}
+
+void join_all()
+{
+  int i;
+  void *retval;
+  for (i = 0; i < NUM_THREAD; i++) {
+    if (thread_join(thread[i], &retval) != 0) {
+      printf(1, "Error joining thread %d\n", i);
+      failed();
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int woken;
+
+  printf(1, "Test 1: Value mismatch\n");
+  flag = 1;
+  if (futex_wait(&flag, 0) != -1) {
+    printf(1, "futex_wait slept although the value has changed\n");
+    failed();
+  }
+  if (futex_wake(&flag, 1) != 0) {
+    printf(1, "futex_wake woke up a thread nobody was waiting\n");
+    failed();
+  }
+  printf(1, "Test 1 passed\n\n");
+
+  printf(1, "Test 2: Wake up waiters\n");
+  flag = 0;
+  create_all(thread_waiter);
+  sleep(100);
+  flag = 1;
+  woken = futex_wake(&flag, NUM_THREAD);
+  printf(1, "woke up %d threads\n", woken);
+  join_all();
+  printf(1, "Test 2 passed\n\n");
+
+  printf(1, "Test 3: Mutex\n");
+  create_all(thread_increase);
+  join_all();
+  if (counter != NUM_THREAD * NUM_INCREASE) {
+    printf(1, "counter expected %d, found %d\n", NUM_THREAD * NUM_INCREASE, counter);
+    failed();
+  }
+  printf(1, "Test 3 passed\n\n");
+
+  printf(1, "All tests passed!\n");
+  exit();
+}
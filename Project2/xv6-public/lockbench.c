@@ -0,0 +1,188 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "uthread.h"
+
+// Benchmark of uthread synchronization primitives
+//
+// usage: lockbench [threads]
+//
+// handoff   two threads pass the turn to each other with mutex and condition variable,
+//           time per handoff shows the latency of waking up the other thread
+// mutex     threads increase a shared counter holding umutex
+// spinlock  same as mutex but with a plain xchg spinlock, for comparison
+// barrier   threads pass a barrier repeatedly
+// rwlock    threads read a shared value, and sometimes write it
+
+#define MAX_THREAD   8
+#define HANDOFF      2000      // round trips of handoff test
+#define NUM_INCREASE 20000     // increases per thread of mutex test
+#define NUM_BARRIER  500       // barrier rounds
+#define NUM_RW       20000     // lock operations per thread of rwlock test
+#define WRITE_EVERY  16        // one write per WRITE_EVERY operations
+
+int nthread = 4;
+thread_t thread[MAX_THREAD];
+
+UMutex mutex;
+UCond cond;
+UBarrier barrier;
+URWLock rwlock;
+volatile uint spin;
+
+volatile int turn;
+volatile int counter;
+
+void failed(char *msg)
+{
+  printf(1, "lockbench: %s\n", msg);
+  exit();
+}
+
+// print elapsed time per operation in microseconds (a tick is 10ms)
+void report(char *name, int ticks, int ops)
+{
+  printf(1, "%s: %d ticks, %d ops, %d us/op\n", name, ticks, ops, ops > 0 ? ticks * 10000 / ops : 0);
+}
+
+int run_threads(int n, void *(*start_routine)(void *))
+{
+  int i, start;
+  void *retval;
+
+  start = uptime();
+  for (i = 0; i < n; i++) {
+    if (thread_create(&thread[i], start_routine, (void*)i) != 0)
+      failed("thread_create failed");
+  }
+  for (i = 0; i < n; i++) {
+    if (thread_join(thread[i], &retval) != 0)
+      failed("thread_join failed");
+  }
+  return uptime() - start;
+}
+
+void *thread_handoff(void *arg)
+{
+  int me = (int)arg;
+  int i;
+
+  for (i = 0; i < HANDOFF; i++) {
+    umutex_lock(&mutex);
+    while (turn != me)
+      ucond_wait(&cond, &mutex);
+    turn = 1 - me;
+    ucond_signal(&cond);
+    umutex_unlock(&mutex);
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void *thread_mutex(void *arg)
+{
+  int i;
+
+  for (i = 0; i < NUM_INCREASE; i++) {
+    umutex_lock(&mutex);
+    counter++;
+    umutex_unlock(&mutex);
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void *thread_spinlock(void *arg)
+{
+  int i;
+
+  for (i = 0; i < NUM_INCREASE; i++) {
+    while (xchg(&spin, 1) != 0)
+      ;
+    counter++;
+    xchg(&spin, 0);
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void *thread_barrier(void *arg)
+{
+  int i;
+
+  for (i = 0; i < NUM_BARRIER; i++) {
+    if (ubarrier_wait(&barrier))
+      counter++;
+  }
+  thread_exit(0);
+  return 0;
+}
+
+void *thread_rwlock(void *arg)
+{
+  int i, value;
+
+  for (i = 0; i < NUM_RW; i++) {
+    if (i % WRITE_EVERY == 0) {
+      urwlock_wrlock(&rwlock);
+      counter++;
+      urwlock_unlock(&rwlock);
+    } else {
+      urwlock_rdlock(&rwlock);
+      value = counter;
+      if (value != counter)
+        failed("value changed while holding read lock");
+      urwlock_unlock(&rwlock);
+    }
+  }
+  thread_exit(0);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int ticks;
+
+  if (argc > 1)
+    nthread = atoi(argv[1]);
+  if (nthread < 2 || nthread > MAX_THREAD) {
+    printf(1, "usage: lockbench [threads(2 ~ %d)]\n", MAX_THREAD);
+    exit();
+  }
+  printf(1, "lockbench: %d threads\n", nthread);
+
+  umutex_init(&mutex);
+  ucond_init(&cond);
+  turn = 0;
+  ticks = run_threads(2, thread_handoff);
+  report("handoff", ticks, 2 * HANDOFF);
+
+  counter = 0;
+  ticks = run_threads(nthread, thread_mutex);
+  if (counter != nthread * NUM_INCREASE)
+    failed("mutex counter mismatch");
+  report("mutex", ticks, nthread * NUM_INCREASE);
+
+  counter = 0;
+  ticks = run_threads(nthread, thread_spinlock);
+  if (counter != nthread * NUM_INCREASE)
+    failed("spinlock counter mismatch");
+  report("spinlock", ticks, nthread * NUM_INCREASE);
+
+  counter = 0;
+  ubarrier_init(&barrier, nthread);
+  ticks = run_threads(nthread, thread_barrier);
+  if (counter != NUM_BARRIER)
+    failed("barrier round mismatch");
+  report("barrier", ticks, NUM_BARRIER);
+
+  counter = 0;
+  urwlock_init(&rwlock);
+  ticks = run_threads(nthread, thread_rwlock);
+  if (counter != nthread * ((NUM_RW + WRITE_EVERY - 1) / WRITE_EVERY))
+    failed("rwlock counter mismatch");
+  report("rwlock", ticks, nthread * NUM_RW);
+
+  exit();
+}
@@ -0,0 +1,229 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "uthread.h"
+
+// Benchmark of malloc against the old K&R allocator
+//
+// usage: mallocbench [threads]
+//
+// The old allocator is copied here as kr_malloc / kr_free,
+// with a global umutex around it since it isn't thread safe.
+// Every thread allocates NLIVE blocks of random size and frees them again, ROUNDS times,
+// checking that no block was overwritten by another.
+//
+// small  sizes up to 512 bytes (served by size classes and thread caches)
+// large  sizes up to 8192 bytes (served by the coalescing free list)
+
+#define MAX_THREAD 8
+#define ROUNDS     200
+#define NLIVE      64
+
+int nthread = 4;
+thread_t thread[MAX_THREAD];
+
+//-------- old allocator (K&R) --------
+
+typedef long Align;
+
+union header {
+  struct {
+    union header *ptr;
+    uint size;
+  } s;
+  Align x;
+};
+
+typedef union header Header;
+
+static Header base;
+static Header *freep;
+UMutex kr_lock;
+
+static void
+kr_free_locked(void *ap)
+{
+  Header *bp, *p;
+
+  bp = (Header*)ap - 1;
+  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
+    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
+      break;
+  if(bp + bp->s.size == p->s.ptr){
+    bp->s.size += p->s.ptr->s.size;
+    bp->s.ptr = p->s.ptr->s.ptr;
+  } else
+    bp->s.ptr = p->s.ptr;
+  if(p + p->s.size == bp){
+    p->s.size += bp->s.size;
+    p->s.ptr = bp->s.ptr;
+  } else
+    p->s.ptr = bp;
+  freep = p;
+}
+
+static Header*
+morecore(uint nu)
+{
+  char *p;
+  Header *hp;
+
+  if(nu < 4096)
+    nu = 4096;
+  p = sbrk(nu * sizeof(Header));
+  if(p == (char*)-1)
+    return 0;
+  hp = (Header*)p;
+  hp->s.size = nu;
+  kr_free_locked((void*)(hp + 1));
+  return freep;
+}
+
+static void*
+kr_malloc_locked(uint nbytes)
+{
+  Header *p, *prevp;
+  uint nunits;
+
+  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if((prevp = freep) == 0){
+    base.s.ptr = freep = prevp = &base;
+    base.s.size = 0;
+  }
+  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
+    if(p->s.size >= nunits){
+      if(p->s.size == nunits)
+        prevp->s.ptr = p->s.ptr;
+      else {
+        p->s.size -= nunits;
+        p += p->s.size;
+        p->s.size = nunits;
+      }
+      freep = prevp;
+      return (void*)(p + 1);
+    }
+    if(p == freep)
+      if((p = morecore(nunits)) == 0)
+        return 0;
+  }
+}
+
+void*
+kr_malloc(uint nbytes)
+{
+  void *ap;
+
+  umutex_lock(&kr_lock);
+  ap = kr_malloc_locked(nbytes);
+  umutex_unlock(&kr_lock);
+  return ap;
+}
+
+void
+kr_free(void *ap)
+{
+  umutex_lock(&kr_lock);
+  kr_free_locked(ap);
+  umutex_unlock(&kr_lock);
+}
+
+//-------- benchmark --------
+
+typedef struct _Workload {
+  void *(*alloc)(uint);
+  void (*release)(void*);
+  uint maxsize;
+} Workload;
+
+Workload workload;
+
+void failed(char *msg)
+{
+  printf(1, "mallocbench: %s\n", msg);
+  exit();
+}
+
+uint rand_next(uint *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return (*seed >> 8) & 0xffffff;
+}
+
+void *thread_work(void *arg)
+{
+  char *block[NLIVE];
+  uint size[NLIVE];
+  uint seed = (uint)arg + 1;
+  int i, r;
+  uint k;
+
+  for (r = 0; r < ROUNDS; r++) {
+    for (i = 0; i < NLIVE; i++) {
+      size[i] = 1 + rand_next(&seed) % workload.maxsize;
+      if ((block[i] = workload.alloc(size[i])) == 0)
+        failed("out of memory");
+      block[i][0] = size[i];
+      block[i][size[i] - 1] = size[i];
+    }
+    // free in random order, moving the last one into the freed place
+    for (k = NLIVE; k > 0; k--) {
+      i = rand_next(&seed) % k;
+      if (block[i][0] != (char)size[i] || block[i][size[i] - 1] != (char)size[i])
+        failed("block overwritten");
+      workload.release(block[i]);
+      block[i] = block[k - 1];
+      size[i] = size[k - 1];
+    }
+  }
+  thread_exit(0);
+  return 0;
+}
+
+int run(int n)
+{
+  int i, start;
+  void *retval;
+
+  start = uptime();
+  for (i = 0; i < n; i++) {
+    if (thread_create(&thread[i], thread_work, (void*)i) != 0)
+      failed("thread_create failed");
+  }
+  for (i = 0; i < n; i++) {
+    if (thread_join(thread[i], &retval) != 0)
+      failed("thread_join failed");
+  }
+  return uptime() - start;
+}
+
+void compare(char *name, uint maxsize, int n)
+{
+  int ticks_old, ticks_new;
+
+  workload.maxsize = maxsize;
+  workload.alloc = kr_malloc;
+  workload.release = kr_free;
+  ticks_old = run(n);
+  workload.alloc = malloc;
+  workload.release = free;
+  ticks_new = run(n);
+  printf(1, "%s, %d threads: old %d ticks, new %d ticks\n", name, n, ticks_old, ticks_new);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1)
+    nthread = atoi(argv[1]);
+  if (nthread < 1 || nthread > MAX_THREAD) {
+    printf(1, "usage: mallocbench [threads(1 ~ %d)]\n", MAX_THREAD);
+    exit();
+  }
+  printf(1, "mallocbench: %d rounds of %d blocks per thread\n", ROUNDS, NLIVE);
+
+  compare("small", 512, 1);
+  compare("small", 512, nthread);
+  compare("large", 8192, 1);
+  compare("large", 8192, nthread);
+
+  exit();
+}
@@ -8,6 +8,14 @@
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
+// Thread stacks are in NTSTACK slots right below KERNBASE, out of [0, sz).
+// A stack grows down from the top of its slot, and pages are mapped on demand.
+// The bottom page of a slot is never mapped, as a guard page.
+#define TSLOTSIZE ((TSTACKMAXPAGES+1)*PGSIZE)
+#define TSTACKBASE (KERNBASE - NTSTACK*TSLOTSIZE)
+#define TSLOT(va) (((uint)(va) - TSTACKBASE) / TSLOTSIZE)   // slot of va in the thread stack region
+#define TSLOTTOP(s) (TSTACKBASE + ((s)+1)*TSLOTSIZE)        // top of slot s, where the stack starts
+
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *) (a)) + KERNBASE))
 
@@ -10,7 +10,15 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       2000  // size of file system in blocks
+#define NFUTEXHASH   64  // number of futex wait lists
+#define FSWEIGHT     10  // default fair share weight of process
+#define FSMAXWEIGHT  100  // maximum fair share weight of process
+#define FSSTRIDE     (1 << 16)  // pass increase of weight 1 process per tick
+#define NTIDHASH     16  // number of tid hash lists of a thread group
+#define NTSTACK      64  // thread stack slots per process
+#define TSTACKMAXPAGES 255  // maximum thread stack size in pages
+#define TSTACKPAGES  16  // thread stack size in pages of thread_create
 
 #define TRUE          1
 #define FALSE         0
\ No newline at end of file
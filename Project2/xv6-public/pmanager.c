@@ -20,6 +20,8 @@ static char* pmanager_cmds[] = {
 [PM_KILL]   "kill",
 [PM_EXEC]   "execute",
 [PM_MEMLIM] "memlim",
+[PM_WEIGHT] "weight",
+[PM_AFFINITY] "affinity",
 [PM_EXIT]   "exit",
 };
 
@@ -30,6 +32,8 @@ static char* pmanager_cmd_args[] = {
 [PM_KILL]   "<pid>",
 [PM_EXEC]   "<path> <stacksize>",
 [PM_MEMLIM] "<pid> <limit>",
+[PM_WEIGHT] "<pid> <weight>",
+[PM_AFFINITY] "<pid> <cpu mask>",
 [PM_EXIT]   "",
 };
 
@@ -40,6 +44,8 @@ static char* pmanager_help_msgs[] = {
 [PM_KILL]   "kill target pid process",
 [PM_EXEC]   "execute target program with given stack size",
 [PM_MEMLIM] "set memory limit of process",
+[PM_WEIGHT] "set CPU share weight of process",
+[PM_AFFINITY] "set CPUs the threads of process run on",
 [PM_EXIT]   "exit process manager",
 };
 
@@ -251,7 +257,7 @@ void print_proc_list_divider(char divider) {
   for (i = 0; i < MAX_PROC_NAME_LEN; i++) {
     printf(2, "%c", divider);
   }
-  for (i = 0; i < 3; i++) {
+  for (i = 0; i < 5; i++) {
     printf(2, "+");
     for (j = 0; j < MAX_INT_FIELD_LEN; j++) {
       printf(2, "%c", divider);
@@ -263,7 +269,7 @@ void print_proc_list_divider(char divider) {
 /// @brief print process list
 void print_proc_list() {
   int proc_num, i, j, k;
-  int int_fields[3];
+  int int_fields[5];
 
   if (proclist(pstat_list, &proc_num) < 0) { // get process list from proclist system call
     print_error("getting process list failed");
@@ -291,12 +297,22 @@ void print_proc_list() {
     for (j = 0; j < (MAX_INT_FIELD_LEN - strlen("memory limit")); j++) {
       printf(2, " ");
     }
+    printf(2, "|weight");
+    for (j = 0; j < (MAX_INT_FIELD_LEN - strlen("weight")); j++) {
+      printf(2, " ");
+    }
+    printf(2, "|cpu mask");
+    for (j = 0; j < (MAX_INT_FIELD_LEN - strlen("cpu mask")); j++) {
+      printf(2, " ");
+    }
     printf(2, "|\n");
 
     for (i = 0; i < proc_num; i++) {
       int_fields[0] = pstat_list[i].stack_page_num;
       int_fields[1] = pstat_list[i].sz;
       int_fields[2] = pstat_list[i].memory_limit;
+      int_fields[3] = pstat_list[i].weight;
+      int_fields[4] = pstat_list[i].affinity;
 
       print_proc_list_divider('-');
 
@@ -309,7 +325,7 @@ void print_proc_list() {
         printf(2, " ");
       }
 
-      for (j = 0; j < 3; j++) {
+      for (j = 0; j < 5; j++) {
         printf(2, "|%d", int_fields[j]);
         for (k = 0; k < (MAX_INT_FIELD_LEN - get_intlen(int_fields[j])); k++) {
           printf(2, " ");
@@ -363,6 +379,28 @@ void setmemorylimit_wrapper(int pid, int limit) {
   }
 }
 
+/// @brief wrapper function for setweight system call
+/// @param pid target process id
+/// @param weight CPU share weight for the process
+void setweight_wrapper(int pid, int weight) {
+  if (setweight(pid, weight) < 0) {
+    print_error("set weight failed");
+  } else {
+    printf(2, "Successfully set weight of Process %d\n", pid);
+  }
+}
+
+/// @brief wrapper function for setaffinity system call
+/// @param pid target process id
+/// @param mask bit i allows CPU i, applied to every thread of the process
+void setaffinity_wrapper(int pid, int mask) {
+  if (setaffinity(pid, -1, mask) < 0) {
+    print_error("set affinity failed");
+  } else {
+    printf(2, "Successfully set affinity of Process %d\n", pid);
+  }
+}
+
 /// @brief check the type of commands and execute the given command
 /// @param cmd_type type of the command
 /// @param arg1_str first argument
@@ -407,6 +445,24 @@ void run_cmd(int cmd_type, char* arg1_str, char* arg2_str) {
       setmemorylimit_wrapper(arg1, arg2);
       break;
 
+    case PM_WEIGHT:
+      if (get_int_arg(arg1_str, &arg1) < 0 || get_int_arg(arg2_str, &arg2) < 0) {
+        print_error("weight - wrong format");
+        break;
+      }
+      printf(2, "Set weight of Process %d to %d\n", arg1, arg2);
+      setweight_wrapper(arg1, arg2);
+      break;
+
+    case PM_AFFINITY:
+      if (get_int_arg(arg1_str, &arg1) < 0 || get_int_arg(arg2_str, &arg2) < 0) {
+        print_error("affinity - wrong format");
+        break;
+      }
+      printf(2, "Set affinity of Process %d to CPU mask %d\n", arg1, arg2);
+      setaffinity_wrapper(arg1, arg2);
+      break;
+
     case PM_EXIT:
       printf(2, "Exit Process Manager\n");
       exit();
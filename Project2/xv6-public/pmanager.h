@@ -3,7 +3,9 @@
 #define PM_KILL     2
 #define PM_EXEC     3
 #define PM_MEMLIM   4
-#define PM_EXIT     5
+#define PM_WEIGHT   5
+#define PM_AFFINITY 6
+#define PM_EXIT     7
 #define PM_ERROR    -1
 
 #define NPROC       64
@@ -21,4 +23,6 @@ void print_proc_list();
 void kill_wrapper(int);
 void execute_process(char*, int);
 void setmemorylimit_wrapper(int, int);
+void setweight_wrapper(int, int);
+void setaffinity_wrapper(int, int);
 void run_cmd(int, char*, char*);
\ No newline at end of file
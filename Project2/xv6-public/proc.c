@@ -8,12 +8,19 @@
 #include "spinlock.h"
 
 #include "pstat.h"
+#include "tls.h"
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  uint vtime;                  // pass of the process picked last by fair_pick
 } ptable;
 
+// Wait lists of futex_wait, hashed by (pgdir, user address), protected by ptable.lock
+struct {
+  struct proc* bucket[NFUTEXHASH];
+} futex_table;
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -21,6 +28,24 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static struct proc* fair_pick(void);
+
+static TNode* tnode_alloc(struct proc*);
+static void tnode_free(struct proc*, TNode*);
+static void tnode_link(struct proc*, TNode*);
+static void tnode_unlink(struct proc*, TNode*);
+static TNode* tnode_find(struct proc*, thread_t);
+static TNode* tnode_first(struct proc*);
+static TNode* tnode_next(struct proc*, TNode*);
+static ThreadGroup* alloc_thread_group(struct proc*);
+static void free_thread_group(struct proc*);
+static int fork_thread_group(struct proc*, struct proc*, struct proc*);
+static uint used_memory(struct proc*);
+static int tstack_map(struct proc*, int, uint);
+static void tstack_release(struct proc*, TNode*);
+static void stop_thread(ThreadGroup*, struct proc*);
+static void park_thread(struct proc*, ThreadGroup*);
+static void change_main_to_curthread(struct proc*, struct proc*);
 
 void
 pinit(void)
@@ -77,7 +102,6 @@ allocproc(void)
 {
   struct proc *p;
   char *sp;
-  int i;
 
   acquire(&ptable.lock);
 
@@ -115,12 +139,11 @@ found:
   memset(p->context, 0, sizeof *p->context);
   p->context->eip = (uint)forkret;
 
-  for (i = 0; i < NPROC; i++) {
-    p->thread_table[i].state = T_UNUSED;
-    p->thread_table[i].retval = 0;
-    p->thread_table[i].thread = 0;
-    p->thread_table[i].ustack_bottom = 0;
-  }
+  p->tgroup = 0;
+  p->thread_info.node = 0;
+  p->tls = 0;
+  p->affinity = ~0;
+  p->last_cpu = -1;
 
   return p;
 }
@@ -159,6 +182,9 @@ userinit(void)
   acquire(&ptable.lock);
 
   p->memory_limit = 0;
+  p->weight = FSWEIGHT;
+  p->pass = 0;
+  p->last_thread = 0;
   p->state = RUNNABLE;
 
   p->thread_num = 0;
@@ -187,8 +213,12 @@ growproc(int n)
   acquire(&ptable.lock);
   sz = main_thread->sz;
   if(n > 0){
-    // check memory limit
-    if (main_thread->memory_limit != 0 && sz + n > main_thread->memory_limit) {
+    // check memory limit, and keep the heap under the thread stack region
+    if (main_thread->memory_limit != 0 && used_memory(main_thread) + n > main_thread->memory_limit) {
+      release(&ptable.lock);
+      return -1;
+    }
+    if (sz + n > TSTACKBASE) {
       release(&ptable.lock);
       return -1;
     }
@@ -237,6 +267,24 @@ fork(void)
   np->sz = main_thread->sz;
   np->parent = main_thread;
   *np->tf = *curproc->tf;
+  np->tls = curproc->tls;
+  np->affinity = curproc->affinity;
+
+  // the stack of the calling thread becomes the main stack of the child
+  if (main_thread != curproc) {
+    acquire(&ptable.lock);
+    if (fork_thread_group(np, main_thread, curproc) < 0) {
+      free_thread_group(np);
+      release(&ptable.lock);
+      freevm(np->pgdir);
+      np->pgdir = 0;
+      kfree(np->kstack);
+      np->kstack = 0;
+      np->state = UNUSED;
+      return -1;
+    }
+    release(&ptable.lock);
+  }
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
@@ -253,26 +301,11 @@ fork(void)
   acquire(&ptable.lock);
 
   np->memory_limit = main_thread->memory_limit;
+  np->weight = main_thread->weight;
+  np->pass = 0; // raised to ptable.vtime when picked first
+  np->last_thread = 0;
   np->state = RUNNABLE;
 
-  for (i = 0; i < NPROC; i++) {
-    if (main_thread->thread_table[i].state != T_UNUSED) {
-      // TODO: main thread 아닌 경우에 스택 페이지 재조정 필요
-      if (main_thread->thread_table[i].thread == curproc) {
-        // just make new process's main stack base to original thread's stack base
-        np->thread_table[i].ustack_bottom = main_thread->main_stack_bottom;
-        np->main_stack_bottom = main_thread->thread_table[i].ustack_bottom;
-
-        main_thread->main_stack_page_num = 2;
-      } else {
-        np->thread_table[i].ustack_bottom = main_thread->thread_table[i].ustack_bottom;
-      }
-      np->thread_table[i].state = T_ALLOCATED;
-    } else {
-      np->thread_table[i].state = T_UNUSED;
-    }
-  }
-
   if (main_thread == curproc) {
     np->main_stack_bottom = main_thread->main_stack_bottom;
     np->main_stack_page_num = main_thread->main_stack_page_num;
@@ -294,37 +327,18 @@ fork(void)
 void
 exit(void)
 {
-  TNode* target;
   struct proc *curproc = myproc();
   struct proc *p;
   struct proc *p_main;
-  struct proc *main_thread;
   int fd;
 
-  main_thread = get_main_thread(curproc);
-
-  if(main_thread == initproc)
+  if(get_main_thread(curproc) == initproc)
     panic("init exiting");
 
-  // check if current process is main thread
-  acquire(&ptable.lock);
-  if (main_thread != curproc) { // if this process is not main
-    main_thread->killed = 1; // to make main process wake up and exit
-    if (main_thread->state == SLEEPING) {
-      main_thread->state = RUNNABLE;
-    }
-    //cprintf("exiting not main - pid: %d, tid: %d\n", main_thread->pid, curproc->thread_info.thread_id);
-    sleep((void*)&curproc->thread_info, &ptable.lock); // sleep and wait until main process do exit 
-  }
-
-  //cprintf("start exiting main\n");
-  for (target = main_thread->thread_table; target < &main_thread->thread_table[NPROC]; target++) {
-    if ((target->state == T_USING || target->state == T_ZOMBIE)) {
-      //cprintf("init not main - tid: %d\n", target->thread->thread_info.thread_id);
-      init_thread_data(target->thread);
-    }
-  }
-  release(&ptable.lock);
+  // the calling thread exits as the main thread of the process after stopping the others,
+  // their stacks are freed with the memory image by wait()
+  stop_other_threads();
+  release_other_threads(FALSE);
 
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
@@ -382,12 +396,14 @@ wait(void)
       if(p_main->parent != main_thread)
         continue;
       havekids = 1;
-      if(p->state == ZOMBIE){
+      // a main thread stopped by another thread of the process (see stop_other_threads) hasn't exited
+      if(p->state == ZOMBIE && (p->tgroup == 0 || p->tgroup->stopper == 0)){
         // Found one.
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
         freevm(p->pgdir);
+        free_thread_group(p);
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
@@ -417,42 +433,109 @@ wait(void)
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
+//
+// CPU time is shared among processes, not threads (see fair_pick).
+// When the next thread shares the page table loaded on this cpu,
+// the page table (and TLB) is kept.
+// The user page table is left loaded only while ptable.lock is held,
+// so it can't be freed by wait(), and switchkvm is called at the end of the round.
 void
 scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int n;
   c->proc = 0;
+  c->pgdir = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
+    // Run up to NPROC threads in a round.
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
+    for(n = 0; n < NPROC && (p = fair_pick()) != 0; n++){
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
       // before jumping back to us.
       c->proc = p;
-      switchuvm(p);
+      if(c->pgdir != 0 && c->pgdir == get_main_thread(p)->pgdir)
+        switchtss(p);
+      else
+        switchuvm(p);
       p->state = RUNNING;
+      p->last_cpu = c - cpus;
 
       swtch(&(c->scheduler), p->context);
-      switchkvm();
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
       c->proc = 0;
     }
+    if(c->pgdir != 0){
+      switchkvm();
+      c->pgdir = 0;
+    }
     release(&ptable.lock);
 
   }
 }
 
+// Pick the thread to run next with stride scheduling among processes (thread groups).
+// The process with the smallest pass runs, and its pass increases by FSSTRIDE / weight,
+// so a process gets CPU time in proportion to its weight however many threads it has.
+// Threads of the process take turns, starting after the thread run last.
+// On a tie, the process whose page table is loaded on this cpu is preferred.
+// Only threads whose affinity allows this cpu are picked, and among the threads of the process,
+// one that ran on this cpu last (or never ran) is preferred to keep its cache warm.
+// Return 0 if there's no RUNNABLE thread. ptable.lock must be held.
+static struct proc*
+fair_pick(void)
+{
+  struct proc *p;
+  struct proc *main_thread;
+  struct proc *group = 0;
+  struct proc *other = 0;
+  pde_t *pgdir = mycpu()->pgdir;
+  int cpu = mycpu() - cpus;
+  int i, start;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != RUNNABLE || !(p->affinity & (1 << cpu)))
+      continue;
+
+    main_thread = get_main_thread(p);
+    // process that has been sleeping doesn't get credit for the time
+    if((int)(main_thread->pass - ptable.vtime) < 0)
+      main_thread->pass = ptable.vtime;
+
+    if(group == 0 || (int)(main_thread->pass - group->pass) < 0 ||
+       (main_thread->pass == group->pass && pgdir != 0 && main_thread->pgdir == pgdir))
+      group = main_thread;
+  }
+
+  if(group == 0)
+    return 0;
+
+  start = group->last_thread != 0 ? group->last_thread - ptable.proc + 1 : 0;
+  for(i = 0; i < NPROC; i++){
+    p = &ptable.proc[(start + i) % NPROC];
+    if(p->state != RUNNABLE || !(p->affinity & (1 << cpu)) || get_main_thread(p) != group)
+      continue;
+    if(p->last_cpu == cpu || p->last_cpu < 0)
+      break;
+    if(other == 0)
+      other = p;
+  }
+  if(i == NPROC)
+    p = other;
+
+  group->last_thread = p;
+  ptable.vtime = group->pass;
+  group->pass += FSSTRIDE / group->weight;
+  return p;
+}
+
 // Enter scheduler.  Must hold only ptable.lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -588,7 +671,7 @@ kill(int pid)
     if(p->pid == pid && p->thread_info.is_main){
       p->killed = 1;
 
-      for (target = p->thread_table; target < &p->thread_table[NPROC]; target++) {
+      for (target = tnode_first(p); target != 0; target = tnode_next(p, target)) {
         if (target->state == T_USING) {
           target->thread->killed = 1;
 
@@ -678,7 +761,7 @@ found:
   } else {
     // check if the new limit is larger than old one
     // also check if the new limit is larger than current memory size
-    if (limit < p->memory_limit || limit < p->sz) {
+    if (limit < p->memory_limit || limit < used_memory(p)) {
       return -1;
     }
 
@@ -688,29 +771,147 @@ found:
   return 0;
 }
 
-/// @brief initialize all threads of the process except for current one
-void kill_other_threads() {
-  TNode* target;
+/// @brief make the thread stop at its next return to user mode (see stop_other_threads)
+/// ptable.lock must be held.
+static void stop_thread(ThreadGroup* tg, struct proc* p) {
+  if (p->state == ZOMBIE) {
+    return;
+  }
+  p->killed = 1;
+  if (p->state == SLEEPING) {
+    p->state = RUNNABLE;
+  }
+  tg->nstopping++;
+}
+
+/// @brief stop the current thread for the thread stopping the process, never returns
+/// The thread stays ZOMBIE until release_other_threads frees it. ptable.lock must be held.
+static void park_thread(struct proc* current_thread, ThreadGroup* tg) {
+  current_thread->state = ZOMBIE;
+  if (--tg->nstopping == 0) {
+    wakeup1(&tg->nstopping);
+  }
+  sched();
+  panic("stopped thread running");
+}
+
+/// @brief stop every other thread of the process, and make the current thread the main thread
+/// Used by exit and exec. All the other threads are killed at once and stop at their next return
+/// to user mode, and the current thread sleeps until the last of them wakes it up,
+/// instead of tearing them down one by one. Stopped threads are freed by release_other_threads.
+/// If another thread is already stopping the process, the current thread stops instead and never returns.
+void stop_other_threads(void) {
   struct proc* current_thread = myproc();
   struct proc* main_thread = get_main_thread(current_thread);
+  ThreadGroup* tg;
+  TNode* target;
+  int killed;
 
   acquire(&ptable.lock);
-  //cprintf("start exiting main\n");
-  for (target = main_thread->thread_table; target < &main_thread->thread_table[NPROC]; target++) {
-    if (target->thread != current_thread && (target->state == T_USING || target->state == T_ZOMBIE)) {
-      init_thread_data(target->thread);
+
+  // no thread has been created
+  if ((tg = main_thread->tgroup) == 0) {
+    release(&ptable.lock);
+    return;
+  }
+
+  if (tg->stopper != 0) {
+    park_thread(current_thread, tg);
+  }
+
+  tg->stopper = current_thread;
+  tg->nstopping = 0;
+  killed = main_thread->killed;
+  if (main_thread != current_thread) {
+    stop_thread(tg, main_thread);
+  }
+  for (target = tnode_first(main_thread); target != 0; target = tnode_next(main_thread, target)) {
+    if (target->thread != current_thread) {
+      stop_thread(tg, target->thread);
     }
   }
+
+  while (tg->nstopping > 0) {
+    sleep(&tg->nstopping, &ptable.lock);
+  }
+
+  // still under ptable.lock, so wait() can't take the stopped main thread for an exited process
+  if (main_thread != current_thread) {
+    change_main_to_curthread(current_thread, main_thread);
+    current_thread->killed = killed;
+  }
+  tg->stopper = 0;
+
   release(&ptable.lock);
 }
 
-void change_main_to_curthread() {
-  struct proc* current_thread = myproc();
-  struct proc* main_thread = get_main_thread(current_thread);
+/// @brief free the threads stopped by stop_other_threads in a batch
+/// Their procs are given back under ptable.lock, while their kernel stacks and stack pages
+/// are freed after releasing it, with a single TLB flush.
+/// No other thread of the process runs any more, so the thread group is used only by the current thread.
+/// @param unmap FALSE to leave stack pages to be freed with the memory image
+void release_other_threads(bool unmap) {
+  struct proc* main_thread = myproc();
+  ThreadGroup* tg;
+  TNode* target;
+  TNode* next;
+  TNode* stopped = 0;
+  char* kstacks[NPROC];
+  int nkstack = 0;
   int i;
-  struct proc* p;
+  uint top;
+
+  acquire(&ptable.lock);
+  if ((tg = main_thread->tgroup) == 0) {
+    release(&ptable.lock);
+    return;
+  }
+  for (target = tnode_first(main_thread); target != 0; target = next) {
+    next = tnode_next(main_thread, target);
+    tnode_unlink(main_thread, target);
+    kstacks[nkstack++] = target->thread->kstack;
+    target->thread->kstack = 0;
+    init_thread_data(target->thread);
+    target->next = stopped;
+    stopped = target;
+  }
+  release(&ptable.lock);
+
+  for (i = 0; i < nkstack; i++) {
+    kfree(kstacks[i]);
+  }
+  if (unmap && stopped != 0) {
+    for (target = stopped; target != 0; target = target->next) {
+      top = TSLOTTOP(target->slot);
+      if (tg->slot[target->slot].mapped > 0) {
+        deallocuvm(main_thread->pgdir, top, top - tg->slot[target->slot].mapped * PGSIZE);
+      }
+    }
+    lcr3(V2P(main_thread->pgdir));
+  }
 
   acquire(&ptable.lock);
+  for (target = stopped; target != 0; target = next) {
+    next = target->next;
+    if (unmap) {
+      tg->nmapped -= tg->slot[target->slot].mapped;
+      tg->slot[target->slot].mapped = 0;
+    }
+    tg->slot[target->slot].pages = 0;
+    target->retval = 0;
+    target->state = T_ALLOCATED;
+    target->thread = 0;
+    tnode_free(main_thread, target);
+  }
+  release(&ptable.lock);
+}
+
+/// @brief move the shared data of the main thread to the current thread, and free the main thread
+/// The main thread must be stopped. ptable.lock must be held.
+static void change_main_to_curthread(struct proc* current_thread, struct proc* main_thread) {
+  TNode* target;
+  int i;
+  struct proc* p;
 
   // copy or move all shared data among threads
   current_thread->sz = main_thread->sz;
@@ -732,10 +933,31 @@ void change_main_to_curthread() {
   current_thread->main_stack_bottom = main_thread->main_stack_bottom;
   current_thread->main_stack_page_num = main_thread->main_stack_page_num;
   current_thread->memory_limit = 0;
+  current_thread->weight = main_thread->weight;
+  current_thread->pass = main_thread->pass;
+  current_thread->last_thread = 0;
 
   // initialize thread table
   current_thread->thread_num = 0;
-  memset(current_thread->thread_table, 0, sizeof (current_thread->thread_table));
+
+  // take over the thread group, the stack of current thread stays in its slot as the main stack
+  current_thread->tgroup = main_thread->tgroup;
+  main_thread->tgroup = 0;
+  if (current_thread->thread_info.node != 0) {
+    current_thread->main_stack_bottom = TSLOTTOP(current_thread->thread_info.node->slot);
+    current_thread->main_stack_page_num = current_thread->tgroup->slot[current_thread->thread_info.node->slot].pages;
+    tnode_unlink(current_thread, current_thread->thread_info.node);
+    current_thread->thread_info.node->state = T_UNUSED;
+    current_thread->thread_info.node->thread = 0;
+    tnode_free(current_thread, current_thread->thread_info.node);
+    current_thread->thread_info.node = 0;
+    init_tls(current_thread->pgdir, current_thread->tls, 0);
+  }
+
+  // stopped threads are freed through the new main thread (see release_other_threads)
+  for (target = tnode_first(current_thread); target != 0; target = tnode_next(current_thread, target)) {
+    target->thread->thread_info.main_ptr = current_thread;
+  }
 
   // set thread information
   current_thread->thread_info.is_main = TRUE;
@@ -754,13 +976,17 @@ void change_main_to_curthread() {
   }
 
   init_thread_data(main_thread);
-
-  release(&ptable.lock);
 }
 
 void init_thread_data(struct proc* target_thread) {
-  kfree(target_thread->kstack);
-  target_thread->kstack = 0;
+  if (target_thread->futex_info.waiting) {
+    futex_unlink(target_thread);
+  }
+
+  if (target_thread->kstack != 0) {
+    kfree(target_thread->kstack);
+    target_thread->kstack = 0;
+  }
 
   target_thread->pid = 0;
   target_thread->parent = 0;
@@ -775,6 +1001,7 @@ void init_thread_data(struct proc* target_thread) {
   target_thread->thread_info.is_main = FALSE;
   target_thread->thread_info.main_ptr = 0;
   target_thread->thread_info.thread_id = 0;
+  target_thread->thread_info.node = 0;
 }
 
 struct proc* get_main_thread(struct proc* p) {
@@ -789,51 +1016,345 @@ struct proc* get_main_thread(struct proc* p) {
   return main_thread;
 }
 
+/// @brief take a thread node from the thread group, allocating the group when it's the first thread
+/// Nodes of the free list are reused first, so a stack left by a joined thread is used again.
+/// ptable.lock must be held.
+/// @param main_thread main thread of the process
+/// @return node in T_UNUSED or T_ALLOCATED state, 0 when out of memory
+static TNode* tnode_alloc(struct proc* main_thread) {
+  ThreadGroup* tg;
+  TNode* node;
+
+  if ((tg = alloc_thread_group(main_thread)) == 0) {
+    return 0;
+  }
+
+  if ((node = tg->free_list) != 0) {
+    tg->free_list = node->next;
+    node->next = 0;
+    return node;
+  }
+
+  // hand out a new node, from the next page if this one is full
+  while (tg->nnode == TG_NNODE) {
+    if (tg->next == 0) {
+      if ((tg->next = (ThreadGroup*)kalloc()) == 0) {
+        return 0;
+      }
+      memset(tg->next, 0, PGSIZE);
+    }
+    tg = tg->next;
+  }
+  return &tg->nodes[tg->nnode++];
+}
+
+/// @brief put the node back to the free list, it keeps its state and stack
+/// ptable.lock must be held.
+static void tnode_free(struct proc* main_thread, TNode* node) {
+  node->next = main_thread->tgroup->free_list;
+  main_thread->tgroup->free_list = node;
+}
+
+/// @brief put the node of T_USING thread into tid hash list
+/// ptable.lock must be held.
+static void tnode_link(struct proc* main_thread, TNode* node) {
+  TNode** head = &main_thread->tgroup->tid_hash[(uint)node->tid % NTIDHASH];
+
+  node->next = *head;
+  *head = node;
+}
+
+/// @brief take out the node from tid hash list
+/// ptable.lock must be held.
+static void tnode_unlink(struct proc* main_thread, TNode* node) {
+  TNode** pp;
+
+  for (pp = &main_thread->tgroup->tid_hash[(uint)node->tid % NTIDHASH]; *pp != 0; pp = &(*pp)->next) {
+    if (*pp == node) {
+      *pp = node->next;
+      node->next = 0;
+      return;
+    }
+  }
+}
+
+/// @brief find the node of T_USING or T_ZOMBIE thread by thread id
+/// ptable.lock must be held.
+/// @return 0 when not found
+static TNode* tnode_find(struct proc* main_thread, thread_t tid) {
+  TNode* node;
+
+  if (main_thread->tgroup == 0) {
+    return 0;
+  }
+  for (node = main_thread->tgroup->tid_hash[(uint)tid % NTIDHASH]; node != 0; node = node->next) {
+    if (node->tid == tid) {
+      return node;
+    }
+  }
+  return 0;
+}
+
+/// @brief first node of T_USING or T_ZOMBIE thread, used with tnode_next to visit every thread
+/// ptable.lock must be held.
+/// @return 0 when there's no thread
+static TNode* tnode_first(struct proc* main_thread) {
+  int i;
+
+  if (main_thread->tgroup == 0) {
+    return 0;
+  }
+  for (i = 0; i < NTIDHASH; i++) {
+    if (main_thread->tgroup->tid_hash[i] != 0) {
+      return main_thread->tgroup->tid_hash[i];
+    }
+  }
+  return 0;
+}
+
+/// @brief node of T_USING or T_ZOMBIE thread next to the given one
+/// ptable.lock must be held.
+/// @return 0 when there's no more thread
+static TNode* tnode_next(struct proc* main_thread, TNode* node) {
+  int i;
+
+  if (node->next != 0) {
+    return node->next;
+  }
+  for (i = (uint)node->tid % NTIDHASH + 1; i < NTIDHASH; i++) {
+    if (main_thread->tgroup->tid_hash[i] != 0) {
+      return main_thread->tgroup->tid_hash[i];
+    }
+  }
+  return 0;
+}
+
+/// @brief free every page of the thread group
+/// ptable.lock must be held, or the process must be no longer used.
+static void free_thread_group(struct proc* main_thread) {
+  ThreadGroup* tg;
+  ThreadGroup* next;
+
+  for (tg = main_thread->tgroup; tg != 0; tg = next) {
+    next = tg->next;
+    kfree((char*)tg);
+  }
+  main_thread->tgroup = 0;
+}
+
+/// @brief allocate the thread group of the process if it doesn't have one
+/// ptable.lock must be held.
+/// @return the thread group, 0 when out of memory
+static ThreadGroup* alloc_thread_group(struct proc* main_thread) {
+  if (main_thread->tgroup == 0) {
+    if ((main_thread->tgroup = (ThreadGroup*)kalloc()) == 0) {
+      return 0;
+    }
+    memset(main_thread->tgroup, 0, PGSIZE);
+  }
+  return main_thread->tgroup;
+}
+
+/// @brief set up the thread group of the process forked by a thread which is not main
+/// The stack slot of the calling thread is copied and kept as the main stack of the child,
+/// and the other slots of the parent are given to the child as free slots without pages.
+/// ptable.lock must be held.
+/// @return 0 when success, -1 when out of memory
+static int fork_thread_group(struct proc* np, struct proc* main_thread, struct proc* curproc) {
+  ThreadGroup* tg;
+  TNode* node;
+  int s, caller;
+
+  caller = curproc->thread_info.node->slot;
+  if ((tg = alloc_thread_group(np)) == 0) {
+    return -1;
+  }
+
+  tg->nslot = main_thread->tgroup->nslot;
+  tg->slot[caller] = main_thread->tgroup->slot[caller];
+  tg->nmapped = tg->slot[caller].mapped;
+  if (copyuvmrange(main_thread->pgdir, np->pgdir, TSLOTTOP(caller) - tg->slot[caller].mapped * PGSIZE, TSLOTTOP(caller)) < 0) {
+    return -1;
+  }
+
+  for (s = 0; s < tg->nslot; s++) {
+    if (s == caller) {
+      continue;
+    }
+    if ((node = tnode_alloc(np)) == 0) {
+      return -1;
+    }
+    node->slot = s;
+    node->state = T_ALLOCATED;
+    tnode_free(np, node);
+  }
+
+  np->main_stack_bottom = TSLOTTOP(caller);
+  np->main_stack_page_num = tg->slot[caller].pages;
+
+  // the calling thread is the main thread of the child
+  return init_tls(np->pgdir, np->tls, 0);
+}
+
+/// @brief memory used by the process, size of memory plus mapped thread stack pages
+static uint used_memory(struct proc* main_thread) {
+  if (main_thread->tgroup == 0) {
+    return main_thread->sz;
+  }
+  return main_thread->sz + main_thread->tgroup->nmapped * PGSIZE;
+}
+
+/// @brief map the pages of stack slot from the page of va up to the pages already mapped
+/// The mapped pages of a slot are always contiguous from the top, like a growing stack.
+/// ptable.lock must be held.
+/// @return 0 when success, -1 when va is out of the stack or out of memory
+static int tstack_map(struct proc* main_thread, int s, uint va) {
+  ThreadGroup* tg = main_thread->tgroup;
+  uint top = TSLOTTOP(s);
+  uint bottom = top - tg->slot[s].mapped * PGSIZE;
+  uint a = PGROUNDDOWN(va);
+  int n;
+
+  if (va >= bottom) {
+    return 0;
+  }
+  if (a < top - tg->slot[s].pages * PGSIZE) {
+    return -1; // guard page
+  }
+
+  n = (bottom - a) / PGSIZE;
+  if (main_thread->memory_limit != 0 && used_memory(main_thread) + n * PGSIZE > main_thread->memory_limit) {
+    return -1;
+  }
+  if (allocuvm(main_thread->pgdir, a, bottom) == 0) {
+    return -1;
+  }
+  tg->slot[s].mapped += n;
+  tg->nmapped += n;
+  return 0;
+}
+
+/// @brief check that [va, va + size) is in the stack of a thread of the current process,
+/// mapping the stack pages not mapped yet.
+/// Used for page faults and for user pointers out of [0, sz).
+/// @return 0 when it's in a stack, -1 when not
+int tstack_check(uint va, uint size) {
+  struct proc* main_thread = get_main_thread(myproc());
+  ThreadGroup* tg;
+  int s, result;
+
+  if (va < TSTACKBASE || va >= KERNBASE || size > TSLOTSIZE) {
+    return -1;
+  }
+  s = TSLOT(va);
+  if (va + size > TSLOTTOP(s)) {
+    return -1;
+  }
+
+  // mapped pages of a slot are never unmapped until exit or exec (see tstack_release),
+  // so they can be checked without lock
+  tg = main_thread->tgroup;
+  if (tg != 0 && va >= TSLOTTOP(s) - tg->slot[s].mapped * PGSIZE) {
+    return 0;
+  }
+
+  acquire(&ptable.lock);
+  tg = main_thread->tgroup;
+  if (tg == 0 || s >= tg->nslot || tg->slot[s].pages == 0) {
+    result = -1;
+  } else {
+    result = tstack_map(main_thread, s, va);
+  }
+  release(&ptable.lock);
+  return result;
+}
+
+/// @brief put the node back to the free list keeping its slot and the stack pages mapped in it
+/// The pages are freed only with the memory image by exit or exec (see release_other_threads).
+/// Other cpus may still have TLB entries of the slot, as they switch between threads
+/// without reloading cr3, and a system call of another thread may be using a pointer into it.
+/// The node must be already out of tid hash list. ptable.lock must be held.
+static void tstack_release(struct proc* main_thread, TNode* node) {
+  main_thread->tgroup->slot[node->slot].pages = 0;
+
+  node->retval = 0;
+  node->state = T_ALLOCATED;
+  node->thread = 0;
+  tnode_free(main_thread, node);
+}
+
+/// @brief write self and tid of the thread local storage at tls, zeroing the rest (see tls.h)
+/// The stack page may be left by a joined thread, so the whole TLS is written.
+/// @return 0 when success, -1 when fail
+int init_tls(pde_t* pgdir, uint tls, thread_t tid) {
+  TLS header;
+
+  memset(&header, 0, sizeof(header));
+  header.self = (TLS*)tls;
+  header.tid = tid;
+  return copyout(pgdir, tls, &header, sizeof(header));
+}
+
+/// @brief free the thread group of the current process
+/// Called by exec after the old memory image with thread stacks is freed.
+void clear_thread_group(void) {
+  acquire(&ptable.lock);
+  free_thread_group(get_main_thread(myproc()));
+  release(&ptable.lock);
+}
+
 // Simillar with allocproc + fork + exec but create a thread not process
-int thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg) {
+// The thread gets a stack slot (see memlayout.h) and its stack can grow up to stack_pages pages.
+int thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg, int stack_pages) {
   // first do allocproc
   struct proc* new_thread;
   struct proc* main_thread;
   struct proc* current_thread = myproc();
   TNode* target;
-  bool already_allocated;
-  uint sz, sp, ustack[2];
+  uint sp, ustack[2];
+
+  if (stack_pages < 1 || stack_pages > TSTACKMAXPAGES) {
+    return -1;
+  }
 
   acquire(&ptable.lock);
 
   // get main thread to get shared data
   main_thread = get_main_thread(current_thread);
   
-  // check memory limit first
-  sz = main_thread->sz;
-  sz = PGROUNDUP(sz);
-  if (main_thread->memory_limit != 0 && main_thread->memory_limit < sz + (2 * PGSIZE)) {
+  // check memory limit first, the top page of the stack is mapped at once
+  if (main_thread->memory_limit != 0 && main_thread->memory_limit < used_memory(main_thread) + PGSIZE) {
     release(&ptable.lock);
     return -1;
   }
 
-  // search for empty thread node
-  already_allocated = FALSE;
-  for (target = main_thread->thread_table; target < &main_thread->thread_table[NPROC]; target++) {
-    if (target->state == T_UNUSED) {
-      goto found;
-    } else if (target->state == T_ALLOCATED) {
-      already_allocated = TRUE;
-      goto found;
+  // take a thread node, it's out of the free list so no one else can take it
+  if ((target = tnode_alloc(main_thread)) == 0) {
+    release(&ptable.lock);
+    return -1;
+  }
+  if (target->state == T_UNUSED) { // node without a stack slot
+    if (main_thread->tgroup->nslot == NTSTACK) {
+      tnode_free(main_thread, target);
+      release(&ptable.lock);
+      return -1;
     }
+    target->slot = main_thread->tgroup->nslot++;
+    target->state = T_ALLOCATED;
   }
-
-  release(&ptable.lock);
-  return -1;
-
-found:
-  target->state = T_ALLOCATED;
+  // a reused slot keeps the pages mapped by its last thread (see tstack_release)
+  if (stack_pages < main_thread->tgroup->slot[target->slot].mapped) {
+    stack_pages = main_thread->tgroup->slot[target->slot].mapped;
+  }
+  main_thread->tgroup->slot[target->slot].pages = stack_pages;
 
   release(&ptable.lock);
 
   // exactly same as allocproc except increasing pid;
   if ((new_thread = allocproc()) == 0) {
-    target->state = T_UNUSED;
+    acquire(&ptable.lock);
+    tstack_release(main_thread, target);
+    release(&ptable.lock);
     return -1;
   }
   new_thread->pid = main_thread->pid;
@@ -843,20 +1364,22 @@ found:
   // alloc memory for thread
   acquire(&ptable.lock);
 
-  if (!already_allocated){ // if stack page has not alloced yet
-    if ((sz = allocuvm(main_thread->pgdir, sz, sz + (2 * PGSIZE))) == 0) {
-      // failed to alloc uvm
-      target->state = T_UNUSED;
-      goto bad;
-    }
-    clearpteu(main_thread->pgdir, (char*)(sz - (2 * PGSIZE)));
-    main_thread->sz = sz;
-    sp = sz;
-    target->ustack_bottom = sz;
-    //cprintf("target: %p, ustack: %p\n", target, target->ustack_bottom);
-  } else { // if this thread will use alloced page
-    sp = target->ustack_bottom;
-    //cprintf("target: %p, ustack: %p\n", target, target->ustack_bottom);
+  // no thread can join while the process is being stopped (see stop_other_threads)
+  if (main_thread->tgroup->stopper != 0) {
+    goto bad;
+  }
+
+  // map the top page of the stack, the others are mapped on page fault
+  sp = TSLOTTOP(target->slot);
+  if (tstack_map(main_thread, target->slot, sp - PGSIZE) < 0) {
+    goto bad;
+  }
+
+  // thread local storage is at the top of the stack
+  sp -= TLSSIZE;
+  new_thread->tls = sp;
+  if (init_tls(main_thread->pgdir, sp, main_thread->thread_num) < 0) {
+    goto bad;
   }
 
   ustack[0] = 0xffffffff;
@@ -871,6 +1394,8 @@ found:
   *(new_thread->tf) = *(current_thread->tf);
   new_thread->tf->eip = (uint)start_routine;
   new_thread->tf->esp = sp;
+  new_thread->tf->gs = (SEG_UTLS << 3) | DPL_USER;
+  new_thread->affinity = current_thread->affinity;
   new_thread->state = RUNNABLE;
   
   target->state = T_USING;
@@ -881,12 +1406,17 @@ found:
   *thread = new_thread->thread_info.thread_id;
   new_thread->thread_info.is_main = FALSE;
   new_thread->thread_info.main_ptr = main_thread;
+  new_thread->thread_info.node = target;
+
+  target->tid = new_thread->thread_info.thread_id;
+  tnode_link(main_thread, target);
   
   release(&ptable.lock);
 
   return 0;
 
 bad:
+  tstack_release(main_thread, target);
   kfree(new_thread->kstack);
   new_thread->kstack = 0;
   new_thread->state = UNUSED;
@@ -897,33 +1427,31 @@ bad:
 
 void thread_exit (void *retval) {
   TNode* target;
-  struct proc* main_thread;
+  ThreadGroup* tg;
   struct proc* current_thread = myproc();
 
   if (current_thread->thread_info.is_main) {
     // TODO: Can main thread exit?
     // TODO: Then have to implement change main
-    main_thread = current_thread;
     exit();
     return;
-  } else {
-    main_thread = current_thread->thread_info.main_ptr;
   }
 
   acquire(&ptable.lock);
 
-  for (target = main_thread->thread_table; target < &main_thread->thread_table[NPROC]; target++) {
-    if (target->thread == current_thread) {
-      goto found;
-    }
+  if ((target = current_thread->thread_info.node) == 0) {
+    panic("unknown thread");
   }
 
-  panic("unknown thread");
-
-found:
   // wake up other thread which is waiting for me
   wakeup1(target);
 
+  // the thread stopping the process counts this thread too
+  tg = get_main_thread(current_thread)->tgroup;
+  if (tg->stopper != 0 && --tg->nstopping == 0) {
+    wakeup1(&tg->nstopping);
+  }
+
   target->retval = retval;
   target->state = T_ZOMBIE;
   current_thread->state = ZOMBIE;
@@ -941,19 +1469,19 @@ int thread_join(thread_t thread, void** retval) {
 
   acquire(&ptable.lock);
 
-  for (target = main_thread->thread_table; target < &main_thread->thread_table[NPROC]; target++) {
-    target_thread = target->thread;
-    if ((target->state == T_USING || target->state == T_ZOMBIE) && target_thread->thread_info.thread_id == thread) {
-      goto found;
-    }
+  if ((target = tnode_find(main_thread, thread)) == 0) {
+    // no target thread found
+    release(&ptable.lock);
+    return -1;
   }
+  target_thread = target->thread;
 
-  // no target thread found
-  release(&ptable.lock);
-  return -1;
-
-found:
-  if (target->state == T_USING) {
+  while (target->state == T_USING) {
+    // the process is exiting, and the target thread may never become zombie
+    if (main_thread->killed || current_thread->killed) {
+      release(&ptable.lock);
+      return -1;
+    }
     sleep(target, &ptable.lock); // sleep against the target thread
   }
 
@@ -964,14 +1492,169 @@ found:
   init_thread_data(target_thread);
 
   *retval = target->retval;
-  target->retval = 0;
-  target->state = T_ALLOCATED;
-  target->thread = 0;
+  tnode_unlink(main_thread, target);
+  tstack_release(main_thread, target);
 
   release(&ptable.lock);
   return 0;
 }
 
+/// @brief set fair share weight of the process
+/// @param pid target process id
+/// @param weight 1 ~ FSMAXWEIGHT
+/// @return 0 when success, -1 when fail
+int setweight(int pid, int weight) {
+  struct proc* p;
+
+  if (weight < 1 || weight > FSMAXWEIGHT) {
+    return -1;
+  }
+
+  acquire(&ptable.lock);
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    if (p->pid == pid && p->thread_info.is_main && p->state != UNUSED && p->state != ZOMBIE) {
+      p->weight = weight;
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+
+  return -1;
+}
+
+/// @brief set CPUs the threads of a process may run on
+/// New threads and forked processes inherit the affinity of the creating thread.
+/// @param pid target process id
+/// @param tid target thread id, or -1 for every thread of the process
+/// @param mask bit i allows CPU i, bits of CPUs not present are ignored
+/// @return 0 when success, -1 when fail
+int setaffinity(int pid, int tid, int mask) {
+  struct proc* p;
+  TNode* target;
+
+  mask &= (1 << ncpu) - 1;
+  if (mask == 0) {
+    return -1;
+  }
+
+  acquire(&ptable.lock);
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    if (p->pid == pid && p->thread_info.is_main && p->state != UNUSED && p->state != ZOMBIE) {
+      goto found;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+
+found:
+  if (tid == -1) {
+    p->affinity = mask;
+    for (target = tnode_first(p); target != 0; target = tnode_next(p, target)) {
+      target->thread->affinity = mask;
+    }
+  } else if (tid == p->thread_info.thread_id) {
+    p->affinity = mask;
+  } else if ((target = tnode_find(p, tid)) != 0 && target->state == T_USING) {
+    target->thread->affinity = mask;
+  } else {
+    release(&ptable.lock);
+    return -1;
+  }
+
+  release(&ptable.lock);
+  return 0;
+}
+
+/// @brief get the futex wait list of the key
+static struct proc** futex_bucket(pde_t* pgdir, uint uaddr) {
+  uint key = (uint)pgdir ^ uaddr;
+
+  return &futex_table.bucket[(key ^ (key >> 6) ^ (key >> 12)) % NFUTEXHASH];
+}
+
+/// @brief take out the thread from its futex wait list, ptable.lock must be held
+void futex_unlink(struct proc* p) {
+  struct proc** pp;
+
+  for (pp = futex_bucket(p->futex_info.pgdir, p->futex_info.uaddr); *pp != 0; pp = &(*pp)->futex_info.next) {
+    if (*pp == p) {
+      *pp = p->futex_info.next;
+      break;
+    }
+  }
+
+  p->futex_info.waiting = FALSE;
+  p->futex_info.next = 0;
+}
+
+/// @brief sleep until futex_wake is called on addr, only if *addr is still val
+/// @param addr user address shared among threads (checked by caller)
+/// @return 0 when woken up by futex_wake, -1 when *addr != val or killed
+int futex_wait(int* addr, int val) {
+  struct proc* current_thread = myproc();
+  struct proc* main_thread = get_main_thread(current_thread);
+  struct proc** bucket;
+
+  acquire(&ptable.lock);
+
+  // checked under ptable.lock, so futex_wake after changing *addr can't be missed
+  if (*addr != val || current_thread->killed || main_thread->killed) {
+    release(&ptable.lock);
+    return -1;
+  }
+
+  bucket = futex_bucket(main_thread->pgdir, (uint)addr);
+  current_thread->futex_info.pgdir = main_thread->pgdir;
+  current_thread->futex_info.uaddr = (uint)addr;
+  current_thread->futex_info.next = *bucket;
+  current_thread->futex_info.waiting = TRUE;
+  *bucket = current_thread;
+
+  sleep(&current_thread->futex_info, &ptable.lock);
+
+  // still in the wait list if woken up by kill
+  if (current_thread->futex_info.waiting) {
+    futex_unlink(current_thread);
+    release(&ptable.lock);
+    return -1;
+  }
+
+  release(&ptable.lock);
+  return 0;
+}
+
+/// @brief wake up at most n threads waiting on addr
+/// @return number of threads woken up
+int futex_wake(int* addr, int n) {
+  struct proc* main_thread = get_main_thread(myproc());
+  struct proc** pp;
+  struct proc* p;
+  int woken = 0;
+
+  acquire(&ptable.lock);
+
+  pp = futex_bucket(main_thread->pgdir, (uint)addr);
+  while (*pp != 0 && woken < n) {
+    p = *pp;
+    if (p->futex_info.pgdir != main_thread->pgdir || p->futex_info.uaddr != (uint)addr) {
+      pp = &p->futex_info.next;
+      continue;
+    }
+
+    *pp = p->futex_info.next;
+    p->futex_info.waiting = FALSE;
+    p->futex_info.next = 0;
+    if (p->state == SLEEPING) {
+      p->state = RUNNABLE;
+    }
+    woken++;
+  }
+
+  release(&ptable.lock);
+  return woken;
+}
+
 /// @brief store inforamtion of all running(RUNNABLE, RUNNING, SLEEPING) process 
 /// @param pstat_list the information will be stored in this array
 /// @param procnum the number of running process will be stored here
@@ -987,7 +1670,9 @@ void proclist(PStat* pstat_list, int* procnum) {
       safestrcpy(pstat_list[i].name, p->name, sizeof(p->name));
       pstat_list[i].pid = p->pid;
       pstat_list[i].stack_page_num = p->main_stack_page_num;
-      pstat_list[i].sz = p->sz;
+      pstat_list[i].sz = used_memory(p);
+      pstat_list[i].weight = p->weight;
+      pstat_list[i].affinity = p->affinity & ((1 << ncpu) - 1);
       i++;
     }
   }
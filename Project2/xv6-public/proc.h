@@ -8,6 +8,7 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  pde_t *pgdir;                // User page table loaded by switchuvm, 0 after switchkvm
 };
 
 extern struct cpu cpus[NCPU];
@@ -38,10 +39,35 @@ enum threadstate { T_UNUSED, T_ALLOCATED, T_USING, T_ZOMBIE };
 typedef struct _TNode {
   enum threadstate state;      // State of thread
   struct proc* thread;         // Pointer of thread proc struct
-  uint ustack_bottom;          // Base address of thread stack page
+  int slot;                    // Thread stack slot, valid unless T_UNUSED
   void* retval;                // Return value of thread
+  thread_t tid;                // Thread id, valid while T_USING or T_ZOMBIE
+  struct _TNode* next;         // Next node in tid hash list, or in free list
 } TNode;
 
+// Thread nodes of a process, allocated as a page when the first thread is created,
+// so a process without threads doesn't pay for them.
+// Nodes of T_USING and T_ZOMBIE threads are in tid_hash,
+// and nodes that can be reused (T_UNUSED, or T_ALLOCATED keeping its stack slot) are in free_list.
+// When every node of the page has been handed out, another page is chained by next.
+typedef struct _ThreadGroup {
+  TNode* tid_hash[NTIDHASH];   // valid only in the first page
+  TNode* free_list;            // valid only in the first page
+  int nslot;                   // number of stack slots handed out, valid only in the first page
+  int nmapped;                 // number of thread stack pages mapped, valid only in the first page
+  struct proc* stopper;        // thread stopping the others (see stop_other_threads), valid only in the first page
+  int nstopping;               // threads yet to stop for stopper, valid only in the first page
+  struct {
+    int pages;                 // stack size limit in pages, 0 when no thread uses the slot
+    int mapped;                // pages mapped from the top of the slot
+  } slot[NTSTACK];             // valid only in the first page
+  int nnode;                   // number of nodes handed out from this page
+  struct _ThreadGroup* next;   // next page of nodes
+  TNode nodes[];
+} ThreadGroup;
+
+#define TG_NNODE ((PGSIZE - sizeof(ThreadGroup)) / sizeof(TNode))
+
 // Per-process state
 struct proc {
   //-------- Shared data among threads (only main thread has valid value) -----------
@@ -59,7 +85,11 @@ struct proc {
   
   int memory_limit;
   int thread_num;
-  TNode thread_table[NPROC];
+  ThreadGroup* tgroup;         // 0 until the first thread is created
+
+  int weight;                  // fair share weight, CPU time is given in proportion to it
+  uint pass;                   // increase FSSTRIDE / weight whenever a thread runs
+  struct proc* last_thread;    // thread of this process run last
   //-------- Shared data among threads (only main thread has valid value) -----------
 
   char *kstack;                // Bottom of kernel stack for this process
@@ -68,12 +98,23 @@ struct proc {
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
+  uint tls;                    // Address of thread local storage (see tls.h)
+  uint affinity;               // Mask of CPUs this thread may run on
+  int last_cpu;                // CPU this thread ran on last, -1 if never
 
   struct {         
     bool is_main;              // TRUE when this is main thread
     struct proc* main_ptr;
     thread_t thread_id;
+    TNode* node;               // node of this thread in the thread group of main thread
   } thread_info;
+
+  struct {
+    bool waiting;              // TRUE while in the futex wait list
+    pde_t* pgdir;              // futex key: page table of the process
+    uint uaddr;                // futex key: user address
+    struct proc* next;         // next waiter in the same futex wait list
+  } futex_info;
 };
 
 // Process memory is laid out contiguously, low addresses first:
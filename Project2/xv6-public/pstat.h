@@ -4,4 +4,6 @@ typedef struct _PStat {
   int stack_page_num;
   uint sz;
   int memory_limit;
+  int weight;
+  int affinity;
 } PStat;
\ No newline at end of file
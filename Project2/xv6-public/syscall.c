@@ -14,12 +14,13 @@
 // to a saved program counter, and then the first argument.
 
 // Fetch the int at addr from the current process.
+// addr may be in a thread stack, out of [0, sz) (see tstack_check).
 int
 fetchint(uint addr, int *ip)
 {
   struct proc *curproc = get_main_thread(myproc());
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if((addr >= curproc->sz || addr+4 > curproc->sz) && tstack_check(addr, 4) < 0)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -34,10 +35,14 @@ fetchstr(uint addr, char **pp)
   char *s, *ep;
   struct proc *curproc = get_main_thread(myproc());
 
-  if(addr >= curproc->sz)
-    return -1;
+  if(addr >= curproc->sz){
+    // string in a thread stack, pages from addr up to the top of the stack are mapped
+    if(tstack_check(addr, 1) < 0)
+      return -1;
+    ep = (char*)TSLOTTOP(TSLOT(addr));
+  } else
+    ep = (char*)curproc->sz;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
     if(*s == 0)
       return s - *pp;
@@ -63,7 +68,9 @@ argptr(int n, char **pp, int size)
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0)
+    return -1;
+  if(((uint)i >= curproc->sz || (uint)i+size > curproc->sz) && tstack_check((uint)i, size) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -109,6 +116,11 @@ extern int sys_thread_join(void);
 extern int sys_exec2(void);
 extern int sys_setmemorylimit(void);
 extern int sys_proclist(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_setweight(void);
+extern int sys_thread_create2(void);
+extern int sys_setaffinity(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -138,6 +150,11 @@ static int (*syscalls[])(void) = {
 [SYS_exec2]           sys_exec2,
 [SYS_setmemorylimit]  sys_setmemorylimit,
 [SYS_proclist]        sys_proclist,
+[SYS_futex_wait]      sys_futex_wait,
+[SYS_futex_wake]      sys_futex_wake,
+[SYS_setweight]       sys_setweight,
+[SYS_thread_create2]  sys_thread_create2,
+[SYS_setaffinity]     sys_setaffinity,
 };
 
 void
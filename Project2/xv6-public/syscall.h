@@ -27,4 +27,10 @@
 
 #define SYS_exec2 25
 #define SYS_setmemorylimit 26
-#define SYS_proclist 27
\ No newline at end of file
+#define SYS_proclist 27
+
+#define SYS_futex_wait 28
+#define SYS_futex_wake 29
+#define SYS_setweight 30
+#define SYS_thread_create2 31
+#define SYS_setaffinity 32
\ No newline at end of file
@@ -109,7 +109,7 @@ sys_thread_create(void) {
   if(argint(2, &arg) < 0)
     return -1;
 
-  return thread_create(thread, (void*(*)(void*))start_routine, (void*)arg);
+  return thread_create(thread, (void*(*)(void*))start_routine, (void*)arg, TSTACKPAGES);
 }
 
 int
@@ -170,4 +170,99 @@ sys_proclist(void) {
   proclist(pstat_list, (int*)procnum);
 
   return 0;
-}
\ No newline at end of file
+}
+
+int
+sys_futex_wait(void) {
+  int* addr;
+  int val;
+
+  if (argptr(0, (void*)&addr, sizeof(*addr)) < 0 || (uint)addr % sizeof(*addr) != 0) {
+    return -1;
+  }
+
+  if (argint(1, &val) < 0) {
+    return -1;
+  }
+
+  return futex_wait(addr, val);
+}
+
+int
+sys_futex_wake(void) {
+  int* addr;
+  int n;
+
+  if (argptr(0, (void*)&addr, sizeof(*addr)) < 0 || (uint)addr % sizeof(*addr) != 0) {
+    return -1;
+  }
+
+  if (argint(1, &n) < 0) {
+    return -1;
+  }
+
+  return futex_wake(addr, n);
+}
+
+int
+sys_setweight(void) {
+  int pid;
+  int weight;
+
+  if (argint(0, &pid) < 0) {
+    return -1;
+  }
+
+  if (argint(1, &weight) < 0) {
+    return -1;
+  }
+
+  return setweight(pid, weight);
+}
+
+int
+sys_thread_create2(void) {
+  thread_t* thread;
+  int start_routine;
+  int arg;
+  int stack_pages;
+
+  if (argptr(0, (void*)&thread, sizeof(*thread)) < 0) {
+    return -1;
+  }
+
+  if (argint(1, &start_routine) < 0) {
+    return -1;
+  }
+
+  if (argint(2, &arg) < 0) {
+    return -1;
+  }
+
+  if (argint(3, &stack_pages) < 0) {
+    return -1;
+  }
+
+  return thread_create(thread, (void*(*)(void*))start_routine, (void*)arg, stack_pages);
+}
+
+int
+sys_setaffinity(void) {
+  int pid;
+  int tid;
+  int mask;
+
+  if (argint(0, &pid) < 0) {
+    return -1;
+  }
+
+  if (argint(1, &tid) < 0) {
+    return -1;
+  }
+
+  if (argint(2, &mask) < 0) {
+    return -1;
+  }
+
+  return setaffinity(pid, tid, mask);
+}
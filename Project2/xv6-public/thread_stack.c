@@ -0,0 +1,106 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NUM_CHURN 500
+#define DEEP_PAGES 64          // stack pages of the deep recursion thread
+#define DEEP_DEPTH 200         // recursion depth, about 1KB of stack per call
+
+int deep_sum;
+
+void failed()
+{
+  printf(1, "Test failed!\n");
+  exit();
+}
+
+void *thread_noop(void *arg)
+{
+  thread_exit(arg);
+  return 0;
+}
+
+int recurse(int depth)
+{
+  volatile char buf[1000]; // volatile, so the stack is really used
+  int i;
+
+  for (i = 0; i < sizeof(buf); i++)
+    buf[i] = 1;
+  if (depth == 0)
+    return buf[0];
+  return recurse(depth - 1) + buf[sizeof(buf) - 1];
+}
+
+void *thread_deep(void *arg)
+{
+  deep_sum = recurse((int)arg);
+  thread_exit(0);
+  return 0;
+}
+
+void *thread_overflow(void *arg)
+{
+  recurse((int)arg);
+  thread_exit(0);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  thread_t thread;
+  void *retval;
+  char *brk;
+  int i, pid;
+
+  printf(1, "Test 1: Create and join repeatedly\n");
+  brk = sbrk(0);
+  for (i = 0; i < NUM_CHURN; i++) {
+    if (thread_create(&thread, thread_noop, (void*)i) != 0) {
+      printf(1, "Error creating thread %d\n", i);
+      failed();
+    }
+    if (thread_join(thread, &retval) != 0 || (int)retval != i) {
+      printf(1, "Error joining thread %d\n", i);
+      failed();
+    }
+  }
+  if (sbrk(0) != brk) {
+    printf(1, "memory size grew by thread stacks\n");
+    failed();
+  }
+  printf(1, "Test 1 passed\n\n");
+
+  printf(1, "Test 2: Stack grows on demand\n");
+  if (thread_create2(&thread, thread_deep, (void*)DEEP_DEPTH, DEEP_PAGES) != 0) {
+    printf(1, "Error creating thread\n");
+    failed();
+  }
+  if (thread_join(thread, &retval) != 0) {
+    printf(1, "Error joining thread\n");
+    failed();
+  }
+  if (deep_sum != DEEP_DEPTH + 1) {
+    printf(1, "sum expected %d, found %d\n", DEEP_DEPTH + 1, deep_sum);
+    failed();
+  }
+  printf(1, "Test 2 passed\n\n");
+
+  printf(1, "Test 3: Stack overflow hits the guard page\n");
+  pid = fork();
+  if (pid < 0) {
+    printf(1, "Error forking\n");
+    failed();
+  }
+  if (pid == 0) {
+    thread_create2(&thread, thread_overflow, (void*)DEEP_DEPTH, 2);
+    thread_join(thread, &retval);
+    printf(1, "thread overflowed its stack without a fault\n");
+    failed();
+  }
+  wait();
+  printf(1, "Test 3 passed\n\n");
+
+  printf(1, "All tests passed!\n");
+  exit();
+}
@@ -0,0 +1,126 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Tear down processes with many threads by exit and exec, and measure how long it takes
+//
+// usage: thread_teardown [threads]
+//
+// A child creates the threads, half of them spinning and half sleeping,
+// and then one of the threads calls exit or exec.
+// The parent measures ticks from the call until the child is waited.
+
+#define MAX_THREAD 60          // with init, sh, this test and the child, it fills the process table
+#define ROUNDS     5
+
+int nthread = MAX_THREAD;
+thread_t thread[MAX_THREAD];
+int fds[2];                    // the child writes the tick of exit or exec here
+
+void failed(char *msg)
+{
+  printf(1, "thread_teardown: %s\n", msg);
+  exit();
+}
+
+void *thread_spin(void *arg)
+{
+  for (;;)
+    ;
+  return 0;
+}
+
+void *thread_sleep(void *arg)
+{
+  sleep(1000);
+  printf(1, "This code shouldn't be executed!!\n");
+  thread_exit(0);
+  return 0;
+}
+
+void report_start(void)
+{
+  int tick = uptime();
+
+  write(fds[1], &tick, sizeof(tick));
+}
+
+void *thread_exit_all(void *arg)
+{
+  sleep(10);
+  report_start();
+  exit();
+  return 0;
+}
+
+void *thread_exec(void *arg)
+{
+  char *args[3] = {"/thread_teardown", "done", 0};
+
+  sleep(10);
+  report_start();
+  exec(args[0], args);
+  printf(1, "exec failed\n");
+  exit();
+  return 0;
+}
+
+void child(void *(*last)(void *))
+{
+  int i;
+
+  for (i = 0; i < nthread - 1; i++) {
+    if (thread_create(&thread[i], i % 2 ? thread_sleep : thread_spin, 0) != 0)
+      failed("thread_create failed");
+  }
+  if (thread_create(&thread[i], last, 0) != 0)
+    failed("thread_create failed");
+  sleep(1000);
+  printf(1, "This code shouldn't be executed!!\n");
+  exit();
+}
+
+int run(void *(*last)(void *))
+{
+  int pid, tick;
+
+  if ((pid = fork()) < 0)
+    failed("fork failed");
+  if (pid == 0)
+    child(last);
+  if (wait() != pid)
+    failed("wait failed");
+  if (read(fds[0], &tick, sizeof(tick)) != sizeof(tick))
+    failed("no tick from the child");
+  return uptime() - tick;
+}
+
+int main(int argc, char *argv[])
+{
+  int i, ticks_exit, ticks_exec;
+
+  // exec'ed by thread_exec
+  if (argc > 1 && strcmp(argv[1], "done") == 0)
+    exit();
+
+  if (argc > 1)
+    nthread = atoi(argv[1]);
+  if (nthread < 1 || nthread > MAX_THREAD) {
+    printf(1, "usage: thread_teardown [threads(1 ~ %d)]\n", MAX_THREAD);
+    exit();
+  }
+
+  if (pipe(fds) < 0)
+    failed("pipe failed");
+
+  printf(1, "thread_teardown: %d threads, %d rounds\n", nthread, ROUNDS);
+  ticks_exit = ticks_exec = 0;
+  for (i = 0; i < ROUNDS; i++) {
+    ticks_exit += run(thread_exit_all);
+    ticks_exec += run(thread_exec);
+  }
+  printf(1, "exit: %d ticks per process\n", ticks_exit / ROUNDS);
+  printf(1, "exec: %d ticks per process\n", ticks_exec / ROUNDS);
+  printf(1, "All tests passed!\n");
+  exit();
+}
@@ -0,0 +1,13 @@
+// Thread local storage
+// Every thread has its TLS at the top of its stack, and %gs of the thread points to it (see SEG_UTLS).
+// The kernel fills self and tid, and the rest is zero when the thread starts.
+
+#define TLSSIZE 256
+#define TLSMCACHESIZE 64
+
+typedef struct _TLS {
+  struct _TLS* self;           // address of this TLS, to get a pointer from %gs
+  thread_t tid;                // thread id of the owner
+  char mcache[TLSMCACHESIZE];  // thread cache of malloc (see umalloc.c)
+  char data[TLSSIZE - 8 - TLSMCACHESIZE]; // free for the thread
+} TLS;
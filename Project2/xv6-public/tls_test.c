@@ -0,0 +1,97 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "uthread.h"
+
+#define NUM_THREAD 5
+#define NUM_INCREASE 10000
+
+thread_t thread[NUM_THREAD];
+
+void failed()
+{
+  printf(1, "Test failed!\n");
+  exit();
+}
+
+// count in TLS, other threads must not see or change it
+void *thread_counter(void *arg)
+{
+  int *counter = tls_area();
+  int i;
+
+  if (*counter != 0) {
+    printf(1, "TLS is not zero at start\n");
+    failed();
+  }
+  for (i = 0; i < NUM_INCREASE; i++) {
+    (*counter)++;
+    if (i % 1000 == 0)
+      sleep(1);
+  }
+  if (*counter != NUM_INCREASE) {
+    printf(1, "counter expected %d, found %d\n", NUM_INCREASE, *counter);
+    failed();
+  }
+  thread_exit((void*)thread_self());
+  return 0;
+}
+
+void *thread_fork(void *arg)
+{
+  int pid;
+
+  pid = fork();
+  if (pid == 0) {
+    if (thread_self() != 0) {
+      printf(1, "forked process is not main thread in TLS\n");
+      failed();
+    }
+    exit();
+  }
+  wait();
+  thread_exit(0);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  void *retval;
+  int i;
+
+  printf(1, "Test 1: Main thread\n");
+  if (thread_self() != 0) {
+    printf(1, "thread id of main thread expected 0, found %d\n", thread_self());
+    failed();
+  }
+  printf(1, "Test 1 passed\n\n");
+
+  printf(1, "Test 2: Counter in TLS\n");
+  for (i = 0; i < NUM_THREAD; i++) {
+    if (thread_create(&thread[i], thread_counter, 0) != 0) {
+      printf(1, "Error creating thread %d\n", i);
+      failed();
+    }
+  }
+  for (i = 0; i < NUM_THREAD; i++) {
+    if (thread_join(thread[i], &retval) != 0) {
+      printf(1, "Error joining thread %d\n", i);
+      failed();
+    }
+    if ((thread_t)retval != thread[i]) {
+      printf(1, "thread_self expected %d, found %d\n", thread[i], (int)retval);
+      failed();
+    }
+  }
+  printf(1, "Test 2 passed\n\n");
+
+  printf(1, "Test 3: Fork in thread\n");
+  if (thread_create(&thread[0], thread_fork, 0) != 0 || thread_join(thread[0], &retval) != 0) {
+    printf(1, "Error running thread\n");
+    failed();
+  }
+  printf(1, "Test 3 passed\n\n");
+
+  printf(1, "All tests passed!\n");
+  exit();
+}
@@ -78,6 +78,12 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // pages of thread stacks are mapped on demand
+    if(myproc() != 0 && (tf->cs&3) == DPL_USER && tstack_check(rcr2(), 1) == 0)
+      break;
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
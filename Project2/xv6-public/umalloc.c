@@ -2,27 +2,94 @@
 #include "stat.h"
 #include "user.h"
 #include "param.h"
+#include "x86.h"
+#include "tls.h"
 
 // Memory allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
+//
+// Made thread safe, with size classes for small blocks.
+// - A request up to MAXSMALL bytes is served from the size class of the next power of 2.
+//   Blocks of a class are carved from a slab, which is a large block, and never coalesced.
+// - Every thread caches free small blocks in its TLS, so most malloc and free of small
+//   blocks take no lock.  Blocks move between the cache and the central list of the class
+//   BATCH blocks at a time.
+// - Larger requests use the K&R free list, which coalesces adjacent free blocks.
+// The central lists and the K&R free list are protected by heap_lock,
+// a futex mutex like umutex, kept here so programs not using libuthread stay small.
+//
+// Blocks cached by a thread are given back by thread_exit (see mflush),
+// since its TLS is gone when the stack slot is reused.
 
 typedef long Align;
 
 union header {
   struct {
     union header *ptr;
-    uint size;
+    uint size;         // units of a large block, or SMALL | size class of a small block
   } s;
   Align x;
 };
 
 typedef union header Header;
 
+#define SMALL     0x80000000
+#define NCLASS    7               // size classes of 16, 32, ..., 1024 bytes
+#define MINSMALL  16
+#define MAXSMALL  (MINSMALL << (NCLASS - 1))
+#define SLABSIZE  4096            // bytes of blocks carved at once
+#define BATCH     8               // blocks moved between a thread cache and a central list at once
+#define CACHEMAX  (2 * BATCH)     // free blocks a thread cache keeps per class
+
+// Thread cache of free small blocks, in mcache of TLS
+typedef struct {
+  Header *head[NCLASS];
+  int count[NCLASS];
+} Cache;
+
 static Header base;
 static Header *freep;
+static Header *central[NCLASS];   // free small blocks of each class
+static volatile uint heap_lock;   // 0: unlocked, 1: locked, 2: locked and some threads may be waiting
 
-void
-free(void *ap)
+static void
+lock_heap(void)
+{
+  if(xchg(&heap_lock, 1) == 0)
+    return;
+  while(xchg(&heap_lock, 2) != 0)
+    futex_wait((int*)&heap_lock, 2);
+}
+
+static void
+unlock_heap(void)
+{
+  if(xchg(&heap_lock, 0) == 2)
+    futex_wake((int*)&heap_lock, 1);
+}
+
+static Cache*
+mycache(void)
+{
+  TLS *tls;
+
+  asm volatile("movl %%gs:0, %0" : "=r" (tls));
+  return (Cache*)tls->mcache;
+}
+
+static int
+size_class(uint nbytes)
+{
+  int c;
+
+  for(c = 0; (MINSMALL << c) < nbytes; c++)
+    ;
+  return c;
+}
+
+// K&R free of a large block, heap_lock must be held.
+static void
+large_free(void *ap)
 {
   Header *bp, *p;
 
@@ -56,12 +123,13 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  large_free((void*)(hp + 1));
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// K&R malloc of a large block, heap_lock must be held.
+static void*
+large_alloc(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
@@ -88,3 +156,130 @@ malloc(uint nbytes)
         return 0;
   }
 }
+
+// Move up to BATCH blocks of class c from the central list to the cache,
+// carving a new slab when the central list is empty.
+// Returns the number of blocks moved.
+static int
+refill(Cache *cache, int c)
+{
+  Header *slab, *bp;
+  uint units, nblock, i;
+  int n;
+
+  lock_heap();
+  if(central[c] == 0){
+    units = (sizeof(Header) + (MINSMALL << c)) / sizeof(Header);
+    nblock = SLABSIZE / (units * sizeof(Header));
+    if(nblock < BATCH)
+      nblock = BATCH;
+    if((slab = large_alloc(nblock * units * sizeof(Header))) == 0){
+      unlock_heap();
+      return 0;
+    }
+    for(i = 0; i < nblock; i++){
+      bp = slab + i * units;
+      bp->s.size = SMALL | c;
+      bp->s.ptr = central[c];
+      central[c] = bp;
+    }
+  }
+  for(n = 0; n < BATCH && central[c] != 0; n++){
+    bp = central[c];
+    central[c] = bp->s.ptr;
+    bp->s.ptr = cache->head[c];
+    cache->head[c] = bp;
+  }
+  unlock_heap();
+  cache->count[c] += n;
+  return n;
+}
+
+// Move n blocks of class c from the cache to the central list.
+static void
+drain(Cache *cache, int c, int n)
+{
+  Header *bp;
+
+  lock_heap();
+  for(; n > 0 && cache->head[c] != 0; n--){
+    bp = cache->head[c];
+    cache->head[c] = bp->s.ptr;
+    bp->s.ptr = central[c];
+    central[c] = bp;
+    cache->count[c]--;
+  }
+  unlock_heap();
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+  Cache *cache;
+  int c;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if(bp->s.size & SMALL){
+    c = bp->s.size & ~SMALL;
+    cache = mycache();
+    bp->s.ptr = cache->head[c];
+    cache->head[c] = bp;
+    if(++cache->count[c] > CACHEMAX)
+      drain(cache, c, BATCH);
+    return;
+  }
+
+  lock_heap();
+  large_free(ap);
+  unlock_heap();
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *bp;
+  Cache *cache;
+  void *ap;
+  int c;
+
+  if(nbytes <= MAXSMALL){
+    c = size_class(nbytes);
+    cache = mycache();
+    if(cache->head[c] == 0 && refill(cache, c) == 0)
+      return 0;
+    bp = cache->head[c];
+    cache->head[c] = bp->s.ptr;
+    cache->count[c]--;
+    return (void*)(bp + 1);
+  }
+
+  lock_heap();
+  ap = large_alloc(nbytes);
+  unlock_heap();
+  return ap;
+}
+
+// Give every block cached by the calling thread back to the central lists.
+void
+mflush(void)
+{
+  Cache *cache = mycache();
+  int c;
+
+  for(c = 0; c < NCLASS; c++)
+    if(cache->count[c] > 0)
+      drain(cache, c, cache->count[c]);
+}
+
+void _thread_exit(void*);
+
+// Exit the calling thread, giving its cached blocks back first.
+void
+thread_exit(void *retval)
+{
+  mflush();
+  _thread_exit(retval);
+}
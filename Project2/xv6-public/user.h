@@ -34,6 +34,12 @@ int setmemorylimit(int, int);
 
 int proclist(struct _PStat*, int*);
 
+int futex_wait(int*, int);
+int futex_wake(int*, int);
+int setweight(int, int);
+int thread_create2(thread_t *, void *(*)(void *), void *, int);
+int setaffinity(int, int, int);
+
 // ulib.c
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
@@ -46,4 +52,5 @@ uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
+void mflush(void);
 int atoi(const char*);
@@ -0,0 +1,195 @@
+#include "types.h"
+#include "param.h"
+#include "user.h"
+#include "x86.h"
+#include "uthread.h"
+#include "tls.h"
+
+// Synchronization primitives for threads.
+// Atomic instructions are used when there's no contention,
+// and futex_wait / futex_wake system calls are used only to block and wake up threads.
+
+#define SPIN_COUNT 100         // tries before blocking in umutex_lock
+#define WAKE_ALL   0x7fffffff
+
+/// @brief initialize the mutex as unlocked
+void umutex_init(UMutex* m) {
+  m->state = 0;
+}
+
+/// @brief acquire the mutex
+/// Spin for a while first, since the holder may release the lock soon,
+/// then mark the lock contended (2) and sleep until the holder wakes us up.
+void umutex_lock(UMutex* m) {
+  int i;
+
+  for (i = 0; i < SPIN_COUNT; i++) {
+    if (m->state == 0 && cmpxchg(&m->state, 0, 1) == 0) {
+      return;
+    }
+    pause();
+  }
+
+  // once contended, keep the state 2 so that the unlocking thread wakes the next waiter
+  while (xchg(&m->state, 2) != 0) {
+    futex_wait((int*)&m->state, 2);
+  }
+}
+
+/// @brief acquire the mutex without blocking
+/// @return 0 when the lock is acquired, -1 when it's held by another thread
+int umutex_trylock(UMutex* m) {
+  return cmpxchg(&m->state, 0, 1) == 0 ? 0 : -1;
+}
+
+/// @brief release the mutex, waking up a waiter if the lock was contended
+void umutex_unlock(UMutex* m) {
+  if (xchg(&m->state, 0) == 2) {
+    futex_wake((int*)&m->state, 1);
+  }
+}
+
+/// @brief initialize the condition variable
+void ucond_init(UCond* c) {
+  c->seq = 0;
+}
+
+/// @brief release the mutex, sleep until signaled and acquire the mutex again
+/// Spurious wakeup is possible, so the caller should check its condition in a loop.
+void ucond_wait(UCond* c, UMutex* m) {
+  uint seq = c->seq;
+
+  umutex_unlock(m);
+  futex_wait((int*)&c->seq, seq); // returns at once if signaled after unlock
+
+  // other threads may be woken up together, so acquire as contended
+  while (xchg(&m->state, 2) != 0) {
+    futex_wait((int*)&m->state, 2);
+  }
+}
+
+/// @brief wake up a thread waiting on the condition variable
+void ucond_signal(UCond* c) {
+  xadd(&c->seq, 1);
+  futex_wake((int*)&c->seq, 1);
+}
+
+/// @brief wake up every thread waiting on the condition variable
+void ucond_broadcast(UCond* c) {
+  xadd(&c->seq, 1);
+  futex_wake((int*)&c->seq, WAKE_ALL);
+}
+
+/// @brief initialize the barrier
+/// @param total number of threads to wait for
+void ubarrier_init(UBarrier* b, int total) {
+  b->count = 0;
+  b->phase = 0;
+  b->total = total;
+}
+
+/// @brief wait until total threads have called ubarrier_wait
+/// @return 1 to the last arrived thread, 0 to others
+int ubarrier_wait(UBarrier* b) {
+  uint phase = b->phase;
+
+  if (xadd(&b->count, 1) + 1 == b->total) {
+    b->count = 0; // reset before releasing, threads of the next phase may come right after
+    xadd(&b->phase, 1);
+    futex_wake((int*)&b->phase, WAKE_ALL);
+    return 1;
+  }
+
+  while (b->phase == phase) {
+    futex_wait((int*)&b->phase, phase);
+  }
+  return 0;
+}
+
+/// @brief initialize the reader-writer lock as unlocked
+void urwlock_init(URWLock* rw) {
+  umutex_init(&rw->lock);
+  ucond_init(&rw->readers_ok);
+  ucond_init(&rw->writer_ok);
+  rw->readers = 0;
+  rw->writer = FALSE;
+  rw->waiting_writers = 0;
+}
+
+/// @brief acquire the read lock
+/// Readers wait while a writer holds or waits for the lock, so writers don't starve.
+void urwlock_rdlock(URWLock* rw) {
+  umutex_lock(&rw->lock);
+  while (rw->writer || rw->waiting_writers > 0) {
+    ucond_wait(&rw->readers_ok, &rw->lock);
+  }
+  rw->readers++;
+  umutex_unlock(&rw->lock);
+}
+
+/// @brief acquire the write lock
+void urwlock_wrlock(URWLock* rw) {
+  umutex_lock(&rw->lock);
+  rw->waiting_writers++;
+  while (rw->writer || rw->readers > 0) {
+    ucond_wait(&rw->writer_ok, &rw->lock);
+  }
+  rw->waiting_writers--;
+  rw->writer = TRUE;
+  umutex_unlock(&rw->lock);
+}
+
+/// @brief release read or write lock, whichever the thread holds
+void urwlock_unlock(URWLock* rw) {
+  umutex_lock(&rw->lock);
+  if (rw->writer) {
+    rw->writer = FALSE;
+  } else {
+    rw->readers--;
+  }
+
+  if (rw->readers == 0) {
+    if (rw->waiting_writers > 0) {
+      ucond_signal(&rw->writer_ok);
+    } else {
+      ucond_broadcast(&rw->readers_ok);
+    }
+  }
+  umutex_unlock(&rw->lock);
+}
+
+/// @brief call fn only once however many threads call uonce with the same o
+/// Threads calling while fn is running wait until it returns.
+void uonce(UOnce* o, void (*fn)(void)) {
+  if (o->state == 2) {
+    return;
+  }
+
+  if (cmpxchg(&o->state, 0, 1) == 0) {
+    fn();
+    xchg(&o->state, 2);
+    futex_wake((int*)&o->state, WAKE_ALL);
+    return;
+  }
+
+  while (o->state != 2) {
+    futex_wait((int*)&o->state, 1);
+  }
+}
+
+/// @brief thread id of the calling thread, read from its TLS through %gs
+thread_t thread_self(void) {
+  thread_t tid;
+
+  asm volatile("movl %%gs:4, %0" : "=r" (tid));
+  return tid;
+}
+
+/// @brief free area of the calling thread's TLS, sizeof(data) of TLS bytes zeroed at thread start
+/// Threads may keep their own caches and counters here without locks.
+void* tls_area(void) {
+  TLS* tls;
+
+  asm volatile("movl %%gs:0, %0" : "=r" (tls));
+  return tls->data;
+}
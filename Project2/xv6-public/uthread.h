@@ -0,0 +1,52 @@
+// Synchronization primitives and thread local storage for threads (see uthread.c)
+// Every primitive is initialized by setting all fields to 0, or by its init function.
+
+typedef struct _UMutex {
+  volatile uint state;         // 0: unlocked, 1: locked, 2: locked and some threads may be waiting
+} UMutex;
+
+typedef struct _UCond {
+  volatile uint seq;           // increase 1 for every signal and broadcast
+} UCond;
+
+typedef struct _UBarrier {
+  volatile uint count;         // number of threads arrived at the current phase
+  volatile uint phase;         // increase 1 when every thread has arrived
+  uint total;                  // number of threads to wait for
+} UBarrier;
+
+typedef struct _URWLock {
+  UMutex lock;                 // protects fields below
+  UCond readers_ok;
+  UCond writer_ok;
+  int readers;                 // number of threads holding read lock
+  int writer;                  // TRUE while a thread holds write lock
+  int waiting_writers;         // waiting writers block new readers (writer preferred)
+} URWLock;
+
+typedef struct _UOnce {
+  volatile uint state;         // 0: not run yet, 1: running, 2: done
+} UOnce;
+
+void umutex_init(UMutex*);
+void umutex_lock(UMutex*);
+int umutex_trylock(UMutex*);
+void umutex_unlock(UMutex*);
+
+void ucond_init(UCond*);
+void ucond_wait(UCond*, UMutex*);
+void ucond_signal(UCond*);
+void ucond_broadcast(UCond*);
+
+void ubarrier_init(UBarrier*, int);
+int ubarrier_wait(UBarrier*);
+
+void urwlock_init(URWLock*);
+void urwlock_rdlock(URWLock*);
+void urwlock_wrlock(URWLock*);
+void urwlock_unlock(URWLock*);
+
+void uonce(UOnce*, void (*)(void));
+
+thread_t thread_self(void);
+void* tls_area(void);
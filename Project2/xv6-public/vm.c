@@ -6,6 +6,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "tls.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -177,7 +178,29 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  // %gs is reloaded from gdt when returning to user space
+  mycpu()->gdt[SEG_UTLS] = SEG16(STA_W, p->tls, TLSSIZE-1, DPL_USER);
   lcr3(V2P(main_thread->pgdir));  // switch to process's address space
+  mycpu()->pgdir = main_thread->pgdir;
+  popcli();
+}
+
+// Switch to thread p which shares the page table already loaded by switchuvm.
+// Only the kernel stack in TSS and the TLS segment are changed. cr3 is not reloaded, so TLB is kept.
+// (esp0 is read from TSS on every trap, so ltr is not needed either)
+void
+switchtss(struct proc *p)
+{
+  if(p == 0)
+    panic("switchtss: no process");
+  if(p->kstack == 0)
+    panic("switchtss: no kstack");
+
+  pushcli();
+  if(mycpu()->pgdir != get_main_thread(p)->pgdir)
+    panic("switchtss: different pgdir");
+  mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
+  mycpu()->gdt[SEG_UTLS] = SEG16(STA_W, p->tls, TLSSIZE-1, DPL_USER);
   popcli();
 }
 
@@ -314,19 +337,17 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+// Copy the pages of [start, end) in a parent's page table
+// to a child's page table d.  start must be page aligned.
+// Returns 0 on success, -1 when out of memory.
+int
+copyuvmrange(pde_t *pgdir, pde_t *d, uint start, uint end)
 {
-  pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
   char *mem;
 
-  if((d = setupkvm()) == 0)
-    return 0;
-  for(i = 0; i < sz; i += PGSIZE){
+  for(i = start; i < end; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
     if(!(*pte & PTE_P))
@@ -334,20 +355,32 @@ copyuvm(pde_t *pgdir, uint sz)
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
     if((mem = kalloc()) == 0)
-      goto bad;
+      return -1;
     memmove(mem, (char*)P2V(pa), PGSIZE);
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
       kfree(mem);
-      goto bad;
+      return -1;
     }
   }
-  return d;
-
-bad:
-  freevm(d);
   return 0;
 }
 
+// Given a parent process's page table, create a copy
+// of it for a child.
+pde_t*
+copyuvm(pde_t *pgdir, uint sz)
+{
+  pde_t *d;
+
+  if((d = setupkvm()) == 0)
+    return 0;
+  if(copyuvmrange(pgdir, d, 0, sz) < 0){
+    freevm(d);
+    return 0;
+  }
+  return d;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
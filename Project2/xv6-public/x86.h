@@ -130,6 +130,37 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// If *addr is oldval, store newval into *addr. Return the old value of *addr.
+static inline uint
+cmpxchg(volatile uint *addr, uint oldval, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; cmpxchgl %2, %0" :
+               "+m" (*addr), "=a" (result) :
+               "r" (newval), "1" (oldval) :
+               "memory", "cc");
+  return result;
+}
+
+// Add val to *addr. Return the old value of *addr.
+static inline uint
+xadd(volatile uint *addr, uint val)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (val), "+m" (*addr) :
+               :
+               "memory", "cc");
+  return val;
+}
+
+// Hint for spin-wait loops.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
 static inline uint
 rcr2(void)
 {
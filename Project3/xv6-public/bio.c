@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,132 +17,296 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Buffers are allocated at boot, 1/BCACHEFRAC of physical memory,
+// and another page of buffers is added whenever every buffer is in use.
+//
+// Locking:
+// * The lock of a hash bucket protects its chain and refcnt of the buffers in it,
+//   so finding a cached block takes only the lock of its bucket.
+// * bcache.lock protects the LRU list, and serializes recycling,
+//   the only place a buffer starts to hold another block.
+//   A bucket lock may be acquired while holding bcache.lock, never the other way around.
+// The LRU list is kept lazily: brelse moves a buffer to the head when it's no longer referenced,
+// but a buffer referenced again stays in the list until brecycle finds it in use.
+//
+// Buffers pinned by the log (see bpin) are kept in two lists, of unreferenced
+// and referenced ones, so the log finds blocks it can commit without scanning the cache.
+// bcache.pinlock protects the lists, and a buffer moves between them
+// holding its bucket lock too, along with the change of refcnt.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
+#define BHASH(blockno) ((blockno) % NBUCKET)
+
+extern char end[]; // first address after kernel loaded from ELF file
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;  // hash chain, through hnext
+};
+
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  int nbuf;
 
-  // Linked list of all buffers, through prev/next.
+  // Linked list of buffers that may be recycled, through prev/next.
   // head.next is most recently used.
   struct buf head;
+
+  // Buffers pinned by the log, through pprev/pnext.
+  struct spinlock pinlock;
+  struct buf *pinned_noref;
+  struct buf *pinned_ref;
 } bcache;
 
+static struct bucket bucket[NBUCKET];
+
+// Unlink b from the LRU list if it's in the list.
+// bcache.lock must be held.
+static void
+lru_remove(struct buf *b)
+{
+  if(b->next == 0)
+    return;
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  b->prev = 0;
+  b->next = 0;
+}
+
+// Move b to the head of the LRU list.
+// bcache.lock must be held.
+static void
+lru_push(struct buf *b)
+{
+  lru_remove(b);
+  b->next = bcache.head.next;
+  b->prev = &bcache.head;
+  bcache.head.next->prev = b;
+  bcache.head.next = b;
+}
+
+// Move b to the pinned list head, or out of the pinned lists if head is 0.
+// bcache.pinlock and the bucket lock of b must be held.
+static void
+pin_move(struct buf *b, struct buf **head)
+{
+  if(b->pinlist == head)
+    return;
+  if(b->pinlist != 0){
+    if(b->pprev)
+      b->pprev->pnext = b->pnext;
+    else
+      *b->pinlist = b->pnext;
+    if(b->pnext)
+      b->pnext->pprev = b->pprev;
+  }
+  b->pinlist = head;
+  if(head != 0){
+    b->pprev = 0;
+    b->pnext = *head;
+    if(*head)
+      (*head)->pprev = b;
+    *head = b;
+  }
+}
+
+// Add a page of buffers holding no block at the tail of the LRU list,
+// so they are recycled first.
+// bcache.lock must be held.  Returns 0 if out of memory.
+static int
+bgrow(void)
+{
+  struct buf *b;
+  char *page;
+
+  if((page = kalloc()) == 0)
+    return 0;
+  memset(page, 0, PGSIZE);
+  for(b = (struct buf*)page; (char*)(b + 1) <= page + PGSIZE; b++){
+    initsleeplock(&b->lock, "buffer");
+    b->bucket = -1;
+    b->next = &bcache.head;
+    b->prev = bcache.head.prev;
+    bcache.head.prev->next = b;
+    bcache.head.prev = b;
+    bcache.nbuf++;
+  }
+  return 1;
+}
+
 void
 binit(void)
 {
-  struct buf *b;
+  int i, npage;
 
   initlock(&bcache.lock, "bcache");
+  initlock(&bcache.pinlock, "bcache.pin");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bucket[i].lock, "bcache.bucket");
 
 //PAGEBREAK!
   // Create linked list of buffers
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  npage = (PHYSTOP - V2P(end)) / PGSIZE / BCACHEFRAC;
+  for(i = 0; i < npage || bcache.nbuf < NBUF; i++){
+    if(!bgrow())
+      panic("binit");
   }
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Take a reference to the block if it's in the bucket.
+// The bucket lock must be held.
 static struct buf*
-bget(uint dev, uint blockno)
+bfind(struct bucket *bk, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b != 0; b = b->hnext){
     if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+      if(b->refcnt++ == 0 && b->pinlist != 0){
+        acquire(&bcache.pinlock);
+        pin_move(b, &bcache.pinned_ref);
+        release(&bcache.pinlock);
+      }
       return b;
     }
   }
+  return 0;
+}
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  // -------- sync when buffer is full ---------
-  // release(&bcache.lock);
-  // wait_until_commit_finish();
-  // acquire(&bcache.lock);
-
-  // while (1) {
-  //   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-  //     if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-  //       b->dev = dev;
-  //       b->blockno = blockno;
-  //       b->flags = 0;
-  //       b->refcnt = 1;
-  //       release(&bcache.lock);
-  //       acquiresleep(&b->lock);
-  //       return b;
-  //     }
-  //   }
-  //   release(&bcache.lock);
-  //   cprintf("bio commit\n");
-  //   commit_wrapper(FALSE);
-  //   acquire(&bcache.lock);
-  // }
-  // -------- sync when buffer is full ---------
-
-  //--------- buffer flush call from log_write -------------
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+// Not cached; recycle the least recently used unused buffer.
+// Even if refcnt==0, B_DIRTY indicates a buffer is in use
+// because log.c has modified it but not yet committed it.
+// Such buffers leave the LRU list, and brelse puts them back.
+static struct buf*
+brecycle(uint dev, uint blockno)
+{
+  struct bucket *bk = &bucket[BHASH(blockno)];
+  struct bucket *old;
+  struct buf *b;
+  struct buf **pp;
+
+  acquire(&bcache.lock);
+
+  // Cached by another process meanwhile?
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno);
+  release(&bk->lock);
+  if(b != 0){
+    release(&bcache.lock);
+    return b;
+  }
+
+  for(;;){
+    b = bcache.head.prev;
+    if(b == &bcache.head){
+      // every buffer is in use
+      if(!bgrow())
+        panic("bget: no buffers");
+      continue;
+    }
+    lru_remove(b);
+    if(b->bucket < 0)
+      break;
+
+    old = &bucket[b->bucket];
+    acquire(&old->lock);
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+      for(pp = &old->head; *pp != b; pp = &(*pp)->hnext)
+        ;
+      *pp = b->hnext;
+      release(&old->lock);
+      break;
     }
+    release(&old->lock);
   }
-  //--------- buffer flush call from log_write -------------
-  
-  panic("bget: no buffers");
+
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  b->bucket = bk - bucket;
+  acquire(&bk->lock);
+  b->hnext = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+
+  release(&bcache.lock);
+  return b;
 }
 
-static int is_noref(int target) {
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct bucket *bk = &bucket[BHASH(blockno)];
   struct buf *b;
 
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    if (b->refcnt == 0 && b->blockno == target) {
-      return 1;
-    }
-  }
+  // Is the block already cached?
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno);
+  release(&bk->lock);
 
-  return 0;
+  if(b == 0)
+    b = brecycle(dev, blockno);
+  acquiresleep(&b->lock);
+  return b;
 }
 
-void bfind_noref_dirty(int n, int* lh_blocks, int* no_ref, int* ref, int* no_ref_n, int* ref_n) {
-  int i;
-  *no_ref_n = 0;
-  *ref_n = 0;
+// Pin b in the cache for the log until bunpin, and track it in the pinned lists.
+// The caller must hold b.
+void
+bpin(struct buf *b)
+{
+  struct bucket *bk = &bucket[b->bucket];
 
-  for (i = 0; i < n; i++) {
-    if (is_noref(lh_blocks[i])) {
-      no_ref[(*no_ref_n)++] = lh_blocks[i];
-    } else {
-      ref[(*ref_n)++] = lh_blocks[i];
-    }
-  }
+  acquire(&bk->lock);
+  acquire(&bcache.pinlock);
+  pin_move(b, b->refcnt > 0 ? &bcache.pinned_ref : &bcache.pinned_noref);
+  release(&bcache.pinlock);
+  release(&bk->lock);
+}
+
+// Unpin b after the log has installed it.  Does nothing if b isn't pinned.
+// The caller must hold b.
+void
+bunpin(struct buf *b)
+{
+  struct bucket *bk = &bucket[b->bucket];
+
+  acquire(&bk->lock);
+  acquire(&bcache.pinlock);
+  pin_move(b, 0);
+  release(&bcache.pinlock);
+  release(&bk->lock);
+}
+
+// Store block numbers of pinned buffers no one references, at most max of them.
+// Returns the number of blocks stored.
+int
+bpinned_noref(int *blocks, int max)
+{
+  struct buf *b;
+  int n = 0;
+
+  acquire(&bcache.pinlock);
+  for(b = bcache.pinned_noref; b != 0 && n < max; b = b->pnext)
+    blocks[n++] = b->blockno;
+  release(&bcache.pinlock);
+  return n;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -158,6 +322,18 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Return a locked buf of the indicated block without reading it from disk.
+// The caller overwrites the whole block, so its old contents don't matter.
+struct buf*
+bgetwhole(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  b->flags |= B_VALID;
+  return b;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -169,28 +345,34 @@ bwrite(struct buf *b)
 }
 
 // Release a locked buffer.
-// Move to the head of the MRU list.
+// Move to the head of the MRU list when no one uses it.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+  uint refcnt;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
+  bk = &bucket[b->bucket];
+  acquire(&bk->lock);
+  refcnt = --b->refcnt;
+  if(refcnt == 0 && b->pinlist != 0){
+    acquire(&bcache.pinlock);
+    pin_move(b, &bcache.pinned_noref);
+    release(&bcache.pinlock);
+  }
+  release(&bk->lock);
+
+  if (refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    acquire(&bcache.lock);
+    lru_push(b);
+    release(&bcache.lock);
   }
-  
-  release(&bcache.lock);
 }
 //PAGEBREAK!
 // Blank page.
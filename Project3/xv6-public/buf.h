@@ -4,8 +4,13 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  struct buf *prev; // LRU cache list, 0 when not in the list
   struct buf *next;
+  struct buf *hnext; // hash bucket chain
+  int bucket;        // hash bucket, -1 when holding no block
+  struct buf **pinlist; // pinned list of bcache the buffer is in, 0 when not pinned (see bpin)
+  struct buf *pprev; // pinned list
+  struct buf *pnext;
   struct buf *qnext; // disk queue
   uchar data[BSIZE];
 };
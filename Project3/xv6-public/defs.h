@@ -13,9 +13,12 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bgetwhole(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
-void            bfind_noref_dirty(int n, int* lh_blocks, int* no_ref, int* ref, int* no_ref_n, int* ref_n);
+void            bpin(struct buf*);
+void            bunpin(struct buf*);
+int             bpinned_noref(int*, int);
 
 // console.c
 void            consoleinit(void);
@@ -42,6 +45,7 @@ struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
+void            bsuminit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
@@ -94,6 +98,7 @@ void            begin_op();
 void            end_op();
 int             commit_wrapper(int);
 void            wait_until_commit_finish();
+void            log_flusher(void) __attribute__((noreturn));
 
 // mp.c
 extern int      ismp;
@@ -116,6 +121,7 @@ void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+void            kthread_create(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -23,6 +23,7 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+3]; // NDIRECT + SINGLE + DOUBLE + TRIPLE
+  uint lastblock;     // block allocated last, the next one is allocated after it
 };
 
 // table mapping major device number to
@@ -79,6 +79,69 @@ void read_test(char* name, int file_block_size) {
   printf(2, "%s files ok\n", name);
 }
 
+// Read a file twice and print ticks of each read.
+// The second read is served from the buffer cache if the file fits in it.
+void cache_test(int file_block_size) {
+  int i, fd, n, start;
+  int buf[BSIZE/sizeof(int)];
+
+  write_test("cache", file_block_size, 1);
+
+  for (i = 0; i < 2; i++) {
+    fd = open("cache", O_RDONLY);
+    if(fd < 0){
+      printf(2, "error: open cache failed!\n");
+      exit();
+    }
+    start = uptime();
+    for (n = 0; read(fd, (char*)buf, 512) == 512; n++)
+      ;
+    printf(2, "read %d blocks: %d ticks\n", n, uptime() - start);
+    close(fd);
+  }
+
+  if(unlink("cache") < 0){
+    printf(2, "unlink cache failed\n");
+    exit();
+  }
+  printf(2, "cache test ok\n");
+}
+
+// Write a file and print how many writes took a tick or longer.
+// Commits are done by the log flusher, so a write rarely waits for one.
+void stall_test(int file_block_size) {
+  int i, fd, t, slow, longest;
+  int buf[BSIZE/sizeof(int)];
+
+  fd = open("stall", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(2, "error: creat stall failed!\n");
+    exit();
+  }
+
+  slow = longest = 0;
+  for (i = 0; i < file_block_size; i++) {
+    buf[(BSIZE/sizeof(int)) - 1] = i;
+    t = uptime();
+    if(write(fd, (char*)buf, 512) != 512){
+      printf(2, "error: %d of write stall file failed\n", i);
+      exit();
+    }
+    t = uptime() - t;
+    if (t > 0)
+      slow++;
+    if (t > longest)
+      longest = t;
+  }
+  close(fd);
+
+  printf(2, "%d writes, %d took a tick or longer, longest %d ticks\n", file_block_size, slow, longest);
+  if(unlink("stall") < 0){
+    printf(2, "unlink stall failed\n");
+    exit();
+  }
+}
+
 void get_filename_test(char* target) {
   char real[PATHSIZ];
   
@@ -242,5 +305,13 @@ main(int argc, char *argv[])
     many_read();
   }
 
+  if (strcmp(argv[1], "c") == 0) {
+    cache_test(DOUBLEBLOCK);
+  }
+
+  if (strcmp(argv[1], "st") == 0) {
+    stall_test(BIGBLOCK);
+  }
+
   exit();
 }
\ No newline at end of file
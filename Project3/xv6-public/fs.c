@@ -44,31 +44,87 @@ bzero(int dev, int bno)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
+  bp = bgetwhole(dev, bno);
   memset(bp->data, 0, BSIZE);
   log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
+//
+// The allocator keeps a summary of the free bitmap in memory:
+// the number of free blocks of each bitmap block, so full ones are skipped
+// without reading them, and a next-fit cursor after the block allocated last.
+// balloc searches from a goal block, the block after the one the inode
+// allocated last (see bmap), so the blocks of a file written sequentially are contiguous.
+// The bitmap itself is still updated through the log, and nfree follows it.
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+struct {
+  struct spinlock lock;
+  int nbmap;           // bitmap blocks
+  int nfree[NBITMAP];  // free blocks of each bitmap block
+  uint cursor;         // block after the one allocated last
+} bsum;
+
+// Count free blocks of the bitmap.  Called after the log is recovered.
+void
+bsuminit(int dev)
 {
-  int b, bi, m;
+  int b, bi, i;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
+  initlock(&bsum.lock, "bsum");
+  bsum.nbmap = (sb.size + BPB - 1) / BPB;
+  if(bsum.nbmap > NBITMAP)
+    panic("bsuminit: too many bitmap blocks");
+  for(i = 0; i < bsum.nbmap; i++){
+    b = i * BPB;
     bp = bread(dev, BBLOCK(b, sb));
+    bsum.nfree[i] = 0;
     for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        bsum.nfree[i]++;
+    }
+    brelse(bp);
+  }
+  bsum.cursor = sb.bmapstart + bsum.nbmap;
+}
+
+// Allocate a disk block, the first free one from goal on,
+// or from the cursor if goal is 0.  The block is zeroed if zero is set.
+static uint
+balloc(uint dev, uint goal, int zero)
+{
+  int b, bi, m, i, k;
+  struct buf *bp;
+
+  if(goal == 0)
+    goal = bsum.cursor;
+  if(goal >= sb.size)
+    goal = 0;
+  // the bitmap block of goal is searched twice, from goal and then from its start
+  for(k = 0; k <= bsum.nbmap; k++){
+    i = (goal / BPB + k) % bsum.nbmap;
+    if(bsum.nfree[i] == 0)  // full
+      continue;
+    b = i * BPB;
+    bp = bread(dev, BBLOCK(b, sb));
+    for(bi = (k == 0 ? goal % BPB : 0); bi < BPB && b + bi < sb.size; bi++){
+      if(bp->data[bi/8] == 0xff){  // skip a full byte
+        bi |= 7;
+        continue;
+      }
       m = 1 << (bi % 8);
       if((bp->data[bi/8] & m) == 0){  // Is block free?
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
+        acquire(&bsum.lock);
+        bsum.nfree[i]--;
+        bsum.cursor = b + bi + 1;
+        release(&bsum.lock);
         brelse(bp);
-        bzero(dev, b + bi);
+        if(zero)
+          bzero(dev, b + bi);
         return b + bi;
       }
     }
@@ -91,6 +147,9 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  acquire(&bsum.lock);
+  bsum.nfree[b / BPB]++;
+  release(&bsum.lock);
   brelse(bp);
 }
 
@@ -179,9 +238,9 @@ iinit(int dev)
   }
 
   readsb(dev, &sb);
-  cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
+  cprintf("sb: size %d nblocks %d ninodes %d nlog %d nloghead %d logstart %d\
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
-          sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
+          sb.ninodes, sb.nlog, sb.nloghead, sb.logstart, sb.inodestart,
           sb.bmapstart);
 }
 
@@ -266,6 +325,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->lastblock = 0;
   release(&icache.lock);
 
   return ip;
@@ -367,17 +427,30 @@ iunlockput(struct inode *ip)
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
 
+// Allocate a block for ip, after the block ip allocated last.
+static uint
+bmap_alloc(struct inode *ip, int zero)
+{
+  ip->lastblock = balloc(ip->dev, ip->lastblock ? ip->lastblock + 1 : 0, zero);
+  return ip->lastblock;
+}
+
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one, zeroed unless
+// zero is 0 and it's a direct block.  A block under an indirect block
+// is always zeroed: the indirect block is logged before the caller logs
+// the data, and the log flusher may commit it alone, so the file would
+// show the stale contents of the block after a crash.  A direct block
+// is pointed to only when iupdate logs the inode, after the data.
 static uint
-bmap(struct inode *ip, uint bn)
+bmap(struct inode *ip, uint bn, int zero)
 {
   uint addr, *a;
   struct buf *bp;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = bmap_alloc(ip, zero);
     return addr;
   }
   bn -= NDIRECT;
@@ -385,11 +458,11 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = bmap_alloc(ip, 1);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = bmap_alloc(ip, 1);
       log_write(bp);
     }
     brelse(bp);
@@ -400,13 +473,13 @@ bmap(struct inode *ip, uint bn)
   bn -= NINDIRECT;
   if (bn < NDOUBLE_INDIRECT) {
     if ((addr = ip->addrs[NDIRECT + 1]) == 0) {
-      ip->addrs[NDIRECT + 1] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT + 1] = addr = bmap_alloc(ip, 1);
     }
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
 
     if((addr = a[bn / NINDIRECT]) == 0) {
-      a[bn / NINDIRECT] = addr = balloc(ip->dev);
+      a[bn / NINDIRECT] = addr = bmap_alloc(ip, 1);
       log_write(bp);
     }
     brelse(bp);
@@ -414,7 +487,7 @@ bmap(struct inode *ip, uint bn)
     a = (uint*)bp->data;
 
     if ((addr = a[bn % NINDIRECT]) == 0) {
-      a[bn % NINDIRECT] = addr = balloc(ip->dev);
+      a[bn % NINDIRECT] = addr = bmap_alloc(ip, 1);
       log_write(bp);
     }
     brelse(bp);
@@ -425,13 +498,13 @@ bmap(struct inode *ip, uint bn)
   bn -= NDOUBLE_INDIRECT;
   if (bn < NTRIPLE_INDIRECT) {
     if ((addr = ip->addrs[NDIRECT + 2]) == 0) {
-      ip->addrs[NDIRECT + 2] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT + 2] = addr = bmap_alloc(ip, 1);
     }
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
 
     if ((addr = a[bn / NDOUBLE_INDIRECT]) == 0) {
-      a[bn / NDOUBLE_INDIRECT] = addr = balloc(ip->dev);
+      a[bn / NDOUBLE_INDIRECT] = addr = bmap_alloc(ip, 1);
       log_write(bp);
     }
     brelse(bp);
@@ -439,7 +512,7 @@ bmap(struct inode *ip, uint bn)
     a = (uint*)bp->data;
 
     if ((addr = a[(bn % NDOUBLE_INDIRECT) / NINDIRECT]) == 0) {
-      a[(bn % NDOUBLE_INDIRECT) / NINDIRECT] = addr = balloc(ip->dev);
+      a[(bn % NDOUBLE_INDIRECT) / NINDIRECT] = addr = bmap_alloc(ip, 1);
       log_write(bp);
     }
     brelse(bp);
@@ -447,7 +520,7 @@ bmap(struct inode *ip, uint bn)
     a = (uint*)bp->data;
 
     if ((addr = a[(bn % NDOUBLE_INDIRECT) % NINDIRECT]) == 0) {
-      a[(bn % NDOUBLE_INDIRECT) % NINDIRECT] = addr = balloc(ip->dev);
+      a[(bn % NDOUBLE_INDIRECT) % NINDIRECT] = addr = bmap_alloc(ip, 1);
       log_write(bp);
     }
     brelse(bp);
@@ -575,7 +648,7 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, bmap(ip, off/BSIZE, 1));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
@@ -604,8 +677,11 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
+    if(m == BSIZE)  // the whole block is overwritten, no need to read it
+      bp = bgetwhole(ip->dev, bmap(ip, off/BSIZE, 0));
+    else
+      bp = bread(ip->dev, bmap(ip, off/BSIZE, 1));
     memmove(bp->data + off%BSIZE, src, m);
     log_write(bp);
     brelse(bp);
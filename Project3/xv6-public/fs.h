@@ -16,6 +16,7 @@ struct superblock {
   uint nblocks;      // Number of data blocks
   uint ninodes;      // Number of inodes.
   uint nlog;         // Number of log blocks
+  uint nloghead;     // Number of log header blocks, at the start of the log
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
@@ -49,6 +50,14 @@ struct dinode {
 // Block of free map containing bit for block b
 #define BBLOCK(b, sb) (b/BPB + sb.bmapstart)
 
+// Log header entries per block
+// The log header is an array of int over the header blocks,
+// the number of logged blocks followed by their block numbers.
+#define LPB           (BSIZE / sizeof(int))
+
+// Header blocks of a log of n data blocks
+#define LOGHEADBLOCKS(n) ((1 + (n) + LPB - 1) / LPB)
+
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
 #define MAXPATHDEPTH 16
@@ -9,27 +9,42 @@
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
-// write an uncommitted system call's updates to disk.
+// calls. The log flusher commits only when there are
+// no FS system calls active: it stops new ones in begin_op()
+// and waits for the active ones to end (see group_commit).
+// Thus there is never any reasoning required about whether
+// a commit might write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// But if a commit is waiting for system calls to end, or if it
+// thinks the log is close to running out, it sleeps until the
+// log flusher commits.
+// Space is reserved this way before the call holds any buffer,
+// so log_write() never waits for space while holding one that
+// a commit may need.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+//   header blocks, containing block #s for block A, B, C, ...
 //   block A
 //   block B
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// The size of the log is chosen by mkfs and read from the superblock,
+// up to LOGSIZE data blocks.  The header spans sb.nloghead blocks (see LPB);
+// the first one holds the count and is written last, so a commit takes
+// effect only once all block #s are on disk.
+//
+// Commits are done by the log flusher, a kernel thread (see log_flusher),
+// so a system call doesn't pay for a commit unless it calls sync.
+// The in-memory header is double-buffered: blocks to commit move from lh to ch,
+// and while ch is written to the log and installed, system calls keep logging blocks to lh.
 
-// Contents of the header block, used for both the on-disk header block
+// Contents of the header blocks, used for both the on-disk header
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
@@ -38,44 +53,129 @@ struct logheader {
 
 struct log {
   struct spinlock lock;
-  int start;
-  int size;
+  int start;       // first header block
+  int nhead;       // header blocks
+  int size;        // data blocks
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  int waiting;     // how many begin_op are waiting for log space.
+  int draining;    // group_commit is waiting for FS sys calls to end.
   int dev;
-  struct logheader lh;
+  uint since;      // ticks when the oldest block of lh was logged.
+  struct logheader lh; // blocks logged since the last commit
+  struct logheader ch; // blocks being committed, the on-disk header
+  int lhhead[LOGHASH]; // index of lh by block number: slot + 1 of the first block in the hash chain, 0 if none
+  int lhnext[LOGSIZE]; // slot + 1 of the next block in the hash chain
+  int noref[LOGSIZE];  // scratch of commit, too big for the kernel stack
 };
 struct log log;
 
+// Buffer out of the cache, to install a block without overwriting its cached copy.
+static struct buf ibuf;
+
 static void recover_from_log(void);
 static int commit();
 
 void
 initlog(int dev)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
-
   struct superblock sb;
   initlock(&log.lock, "log");
   readsb(dev, &sb);
   log.start = sb.logstart;
-  log.size = sb.nlog;
+  log.nhead = sb.nloghead;
+  log.size = sb.nlog - sb.nloghead;
+  if (log.size > LOGSIZE)
+    log.size = LOGSIZE;
+  if (log.nhead < 1 || log.size < MAXOPBLOCKS || LOGHEADBLOCKS(log.size) > log.nhead)
+    panic("initlog: bad log size");
   log.dev = dev;
+  initsleeplock(&ibuf.lock, "log install");
   recover_from_log();
+  kthread_create("log_flusher", log_flusher);
+}
+
+// Slot of the block in lh, or -1 if it isn't logged.
+// log.lock must be held.
+static int
+lh_find(int blockno)
+{
+  int s;
+
+  for (s = log.lhhead[blockno % LOGHASH] - 1; s >= 0; s = log.lhnext[s] - 1) {
+    if (log.lh.block[s] == blockno)
+      return s;
+  }
+  return -1;
+}
+
+// Append the block to lh.  log.lock must be held.
+static void
+lh_append(int blockno)
+{
+  int s = log.lh.n++;
+
+  log.lh.block[s] = blockno;
+  log.lhnext[s] = log.lhhead[blockno % LOGHASH];
+  log.lhhead[blockno % LOGHASH] = s + 1;
 }
 
-// Copy committed blocks from log to their home location
+// Rebuild the index after the blocks of lh are rewritten.
+// log.lock must be held.
+static void
+lh_reindex(void)
+{
+  int i, n = log.lh.n;
+
+  memset(log.lhhead, 0, sizeof(log.lhhead));
+  log.lh.n = 0;
+  for (i = 0; i < n; i++)
+    lh_append(log.lh.block[i]);
+}
+
+// Is the block logged in lh, to be committed next time?
+static int
+logged(uint blockno)
+{
+  int found;
+
+  acquire(&log.lock);
+  found = lh_find(blockno) >= 0;
+  release(&log.lock);
+  return found;
+}
+
+// Write the data of lbuf to block blockno on disk, bypassing the cache.
+static void
+install_direct(struct buf *lbuf, uint blockno)
+{
+  acquiresleep(&ibuf.lock);
+  ibuf.dev = log.dev;
+  ibuf.blockno = blockno;
+  ibuf.flags = B_VALID | B_DIRTY;
+  memmove(ibuf.data, lbuf->data, BSIZE);
+  iderw(&ibuf);
+  releasesleep(&ibuf.lock);
+}
+
+// Copy committed blocks from log to their home location.
+// A block logged again since write_log has newer data in the cache,
+// so it is installed without the cache and stays pinned for the next commit.
 static void
 install_trans(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
+  for (tail = 0; tail < log.ch.n; tail++) {
+    struct buf *lbuf = bread(log.dev, log.start+log.nhead+tail); // read log block
+    struct buf *dbuf = bread(log.dev, log.ch.block[tail]); // read dst
+    if (logged(dbuf->blockno)) {
+      install_direct(lbuf, dbuf->blockno);
+    } else {
+      memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
+      bwrite(dbuf);  // write dst to disk
+      bunpin(dbuf);
+    }
     brelse(lbuf);
     brelse(dbuf);
   }
@@ -86,11 +186,19 @@ static void
 read_head(void)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  int *hb = (int *) (buf->data);
+  int i, e;
+  log.ch.n = hb[0];
+  if (log.ch.n < 0 || log.ch.n > log.size)
+    panic("read_head: bad log header");
+  for (i = 0; i < log.ch.n; i++) {
+    e = i + 1;  // entry 0 is the count
+    if (e % LPB == 0) {  // next header block
+      brelse(buf);
+      buf = bread(log.dev, log.start + e / LPB);
+      hb = (int *) (buf->data);
+    }
+    log.ch.block[i] = hb[e % LPB];
   }
   brelse(buf);
 }
@@ -98,18 +206,27 @@ read_head(void)
 // Write in-memory log header to disk.
 // This is the true point at which the
 // current transaction commits.
+// Header blocks other than the first are written before it,
+// as it holds the count that makes the block #s valid.
 static void
 write_head(void)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  struct buf *buf;
+  int *hb;
+  int b, i, nb;
+
+  nb = LOGHEADBLOCKS(log.ch.n);
+  for (b = nb - 1; b >= 0; b--) {
+    buf = bread(log.dev, log.start + b);
+    hb = (int *) (buf->data);
+    // entry k of the header is block k-1 of ch, entry 0 is the count
+    for (i = (b == 0); i < LPB && b*LPB + i <= log.ch.n; i++)
+      hb[i] = log.ch.block[b*LPB + i - 1];
+    if (b == 0)
+      hb[0] = log.ch.n;
+    bwrite(buf);
+    brelse(buf);
   }
-  bwrite(buf);
-  brelse(buf);
 }
 
 static void
@@ -117,7 +234,7 @@ recover_from_log(void)
 {
   read_head();
   install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
+  log.ch.n = 0;
   write_head(); // clear the log
 }
 
@@ -143,18 +260,19 @@ begin_op(void)
   // }
   //--------- buffer flush call from begin_op -------------
 
-  //--------- buffer flush call from log_write -------------
+  //--------- group commit by log flusher -------------
+  // a commit in progress doesn't stop new system calls, unless
+  // a commit is about to start or this op might exhaust log space
   acquire(&log.lock);
-  while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else {
-      log.outstanding += 1;
-      release(&log.lock);
-      break;
-    }
+  while (log.draining || log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > log.size) {
+    // the log flusher will commit
+    log.waiting++;
+    sleep(&log, &log.lock);
+    log.waiting--;
   }
-  //--------- buffer flush call from log_write -------------
+  log.outstanding += 1;
+  release(&log.lock);
+  //--------- group commit by log flusher -------------
 }
 
 // called at the end of each FS system call.
@@ -204,9 +322,9 @@ write_log(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
+  for (tail = 0; tail < log.ch.n; tail++) {
+    struct buf *to = bread(log.dev, log.start+log.nhead+tail); // log block
+    struct buf *from = bread(log.dev, log.ch.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
     bwrite(to);  // write the log
     brelse(from);
@@ -214,80 +332,54 @@ write_log(void)
   }
 }
 
+// Commit the blocks of lh, or only the blocks no one is using unless sync_all.
+// Called with log.lock held, which is released during the commit.
+// Returns the number of committed blocks.
 static int
 commit(int sync_all)
 {
   int flushed_num = 0;
-  int no_ref_n;
-  int ref_n;
-  int no_ref_blocks[LOGSIZE];
-  int ref_blocks[LOGSIZE];
-  int i;
-
-  //--------- buffer flush call from begin_op -------------
-  // while (1) {
-  //   if (log.committing) { // did someone call commit already?
-  //     sleep(&log, &log.lock);
-  //   } else if (log.outstanding > 0) { // no active transaction
-  //     sleep(&log, &log.lock);
-  //   } else {
-  //     break;
-  //   }
-  // }
-  //--------- buffer flush call from begin_op -------------
+  int noref_n;
+  int i, n, s;
 
-  //--------- buffer flush call from log_write -------------
-  while (1) {
-    if (log.committing) { // did someone call commit already?
-      sleep(&log, &log.lock);
-    } else {
-      break;
-    }
+  while (log.committing) { // did someone call commit already?
+    sleep(&log, &log.lock);
   }
-  //--------- buffer flush call from log_write -------------
-
   log.committing = 1;
-  release(&log.lock);
 
-  //--------- buffer flush call from begin_op -------------
-  // if (log.lh.n > 0) {
-  //   flushed_num = log.lh.n;
-  //   write_log();     // Write modified blocks from cache to log
-  //   write_head();    // Write header to disk -- the real commit
-  //   install_trans(); // Now install writes to home locations
-  //   log.lh.n = 0;
-  //   write_head();    // Erase the transaction from the log
-  // }
-  //--------- buffer flush call from begin_op -------------
-  
-  //--------- buffer flush call from log_write -------------
-  if (log.lh.n > 0) {
-    if (sync_all) {
-      flushed_num = log.lh.n;
-      write_log();     // Write modified blocks from cache to log
-      write_head();    // Write header to disk -- the real commit
-      install_trans(); // Now install writes to home locations
-      log.lh.n = 0;
-      write_head();    // Erase the transaction from the log
-    } else {
-      bfind_noref_dirty(log.lh.n, log.lh.block, no_ref_blocks, ref_blocks, &no_ref_n, &ref_n); // find blocks that ref == 0
-      for (i = 0; i < no_ref_n; i++) {
-        log.lh.block[i] = no_ref_blocks[i];
-      }
-      log.lh.n = no_ref_n;
-      flushed_num = no_ref_n;
-      write_log();
-      write_head();
-      install_trans();
-      log.lh.n = 0;
-      write_head();
-      for (i = 0; i < ref_n; i++) {
-        log.lh.block[i] = ref_blocks[i];
+  // move the blocks to commit from lh to ch, the others stay in lh for the next commit
+  if (sync_all) {
+    log.ch = log.lh;
+    log.lh.n = 0;
+  } else {
+    // blocks that ref == 0, the buffer cache keeps track of them (see bpin)
+    noref_n = bpinned_noref(log.noref, LOGSIZE);
+    log.ch.n = 0;
+    for (i = 0; i < noref_n; i++) {
+      if ((s = lh_find(log.noref[i])) >= 0) {
+        log.ch.block[log.ch.n++] = log.noref[i];
+        log.lh.block[s] = -1;
       }
-      log.lh.n = ref_n;
     }
+    for (i = n = 0; i < log.lh.n; i++) {
+      if (log.lh.block[i] != -1)
+        log.lh.block[n++] = log.lh.block[i];
+    }
+    log.lh.n = n;
+  }
+  lh_reindex();
+  log.since = ticks;
+  wakeup(&log); // begin_op may be waiting for log space
+  release(&log.lock);
+
+  if (log.ch.n > 0) {
+    flushed_num = log.ch.n;
+    write_log();     // Write modified blocks from cache to log
+    write_head();    // Write header to disk -- the real commit
+    install_trans(); // Now install writes to home locations
+    log.ch.n = 0;
+    write_head();    // Erase the transaction from the log
   }
-  //--------- buffer flush call from log_write --------------
 
   acquire(&log.lock);
   log.committing = 0;
@@ -297,11 +389,29 @@ commit(int sync_all)
   return flushed_num;
 }
 
+// Commit every block of lh once the FS sys calls in progress have ended,
+// so a commit never writes part of a system call's updates.
+// New system calls wait in begin_op meanwhile.
+// Called with log.lock held, and never inside begin_op/end_op.
+// Returns the number of committed blocks.
+static int
+group_commit(void)
+{
+  while (log.committing || log.outstanding > 0) {
+    log.draining = 1;
+    sleep(&log, &log.lock);
+  }
+  // commit moves lh to ch before releasing log.lock,
+  // so system calls let in from now on log to the next transaction
+  log.draining = 0;
+  return commit(TRUE);
+}
+
 int commit_wrapper(int sync_all) {
   int n;
 
   acquire(&log.lock);
-  n = commit(sync_all);
+  n = sync_all ? group_commit() : commit(FALSE);
   release(&log.lock);
 
   return n;
@@ -339,15 +449,6 @@ log_write(struct buf *b)
   // }
   //--------- buffer flush call from begin_op -------------
 
-  //--------- buffer flush call from log_write -------------
-  wait_until_commit_finish(); // wait until commit finish
-
-  if (log.lh.n >= LOGSIZE - 1 || log.lh.n >= log.size - 2) {
-    //cprintf("log has %d blocks\n", log.lh.n);
-    commit_wrapper(FALSE);
-  }
-  //--------- buffer flush call from log_write -------------
-
   //--------- buffer flush call from bget -----------
   // wait_until_commit_finish();
 
@@ -360,15 +461,41 @@ log_write(struct buf *b)
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
+  //--------- group commit by log flusher -------------
+  // begin_op has reserved space, so the log never is full here
   acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorbtion
-      break;
+  i = lh_find(b->blockno);   // log absorbtion
+  if (i < 0 && log.lh.n >= log.size)
+    panic("too big a transaction");
+  //--------- group commit by log flusher -------------
+
+  if (i < 0) {
+    if (log.lh.n == 0)
+      log.since = ticks;
+    lh_append(b->blockno);
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n)
-    log.lh.n++;
   b->flags |= B_DIRTY; // prevent eviction
+  bpin(b);
   release(&log.lock);
 }
 
+// Kernel thread committing the log in the background (see kthread_create).
+// Checks the log every tick, and commits when 1/LOGFLUSHFRAC of the log is used,
+// when a block has waited LOGFLUSHTICKS, or when begin_op is waiting for space.
+// Commits of blocks logged by many system calls are grouped together this way,
+// and only whole system calls are committed (see group_commit).
+void
+log_flusher(void)
+{
+  for (;;) {
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    acquire(&log.lock);
+    if (log.lh.n >= log.size / LOGFLUSHFRAC || log.waiting > 0 || (log.lh.n > 0 && ticks - log.since >= LOGFLUSHTICKS)) {
+      group_commit();
+    }
+    release(&log.lock);
+  }
+}
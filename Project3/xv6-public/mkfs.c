@@ -22,7 +22,8 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog;     // Number of log blocks (header and data)
+int nloghead; // Number of log header blocks
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -67,7 +68,8 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
+  int i, cc, fd, first;
+  int nlogdata = LOGSIZE;
   uint rootino, inum, off;
   struct dirent de;
   char buf[BSIZE];
@@ -77,10 +79,23 @@ main(int argc, char *argv[])
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs fs.img [-l logblocks] files...\n");
     exit(1);
   }
 
+  // -l: data blocks of the log, LOGSIZE by default
+  first = 2;
+  if(argc > 3 && strcmp(argv[2], "-l") == 0){
+    nlogdata = atoi(argv[3]);
+    if(nlogdata < MAXOPBLOCKS || nlogdata > LOGSIZE){
+      fprintf(stderr, "mkfs: log blocks must be %d ~ %d\n", MAXOPBLOCKS, LOGSIZE);
+      exit(1);
+    }
+    first = 4;
+  }
+  nloghead = LOGHEADBLOCKS(nlogdata);
+  nlog = nloghead + nlogdata;
+
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
@@ -98,12 +113,13 @@ main(int argc, char *argv[])
   sb.nblocks = xint(nblocks);
   sb.ninodes = xint(NINODES);
   sb.nlog = xint(nlog);
+  sb.nloghead = xint(nloghead);
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u (header %u) inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
+         nmeta, nlog, nloghead, ninodeblocks, nbitmap, nblocks, FSSIZE);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
@@ -127,7 +143,7 @@ main(int argc, char *argv[])
   strcpy(de.name, "..");
   iappend(rootino, &de, sizeof(de));
 
-  for(i = 2; i < argc; i++){
+  for(i = first; i < argc; i++){
     assert(index(argv[i], '/') == 0);
 
     if((fd = open(argv[i], 0)) < 0){
@@ -8,7 +8,13 @@
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define LOGSIZE      1024  // max data blocks in on-disk log, mkfs may make the log smaller
+#define LOGHASH      (LOGSIZE*2)  // hash buckets of the index of logged blocks
+#define LOGFLUSHFRAC 2  // the log flusher commits when 1/LOGFLUSHFRAC of the log is used
+#define LOGFLUSHTICKS 10  // ticks a logged block waits for the log flusher at most
+#define NBUF         (MAXOPBLOCKS*3)  // minimum size of disk block cache
+#define BCACHEFRAC   16  // disk block cache gets 1/BCACHEFRAC of physical memory
+#define NBUCKET    2039  // hash buckets of disk block cache
 #define FSSIZE       100000  // size of file system in blocks
+#define NBITMAP      (FSSIZE/(BSIZE*8) + 1)  // maximum free bitmap blocks
 
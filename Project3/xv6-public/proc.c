@@ -115,6 +115,27 @@ found:
   return p;
 }
 
+//PAGEBREAK: 32
+// Start a kernel thread running fn, which must never return.
+// It's a process without user memory, and fn runs in place of
+// trapret after forkret (see allocproc).
+void
+kthread_create(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread_create: no proc");
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kthread_create: out of memory");
+  *(uint*)(p->context + 1) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+}
+
 //PAGEBREAK: 32
 // Set up first user process.
 void
@@ -407,6 +428,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    bsuminit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).